@@ -0,0 +1,96 @@
+/*
+    Pool of payload buffers reserved at compile time
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "BufferPool.h"
+
+/*
+    The command handlers get their buffers from a statically reserved memory instead of the heap,
+    so the steady traffic does not fragment the heap. A request is served by the smallest class
+    with a free buffer, it fails when the pool cannot serve it.
+    The pool is used only by the main code (not by the interrupt handlers).
+ */
+
+typedef struct {
+    uint16_t size;   // buffer size
+    uint8_t count;   // number of buffers
+} tPoolClass;
+
+static constexpr tPoolClass poolClasses[] = { BUFFER_POOL_CLASSES };
+static constexpr uint8_t POOL_CLASS_COUNT = sizeof(poolClasses) / sizeof(poolClasses[0]);
+
+// Offset of the class in the pool memory
+constexpr uint32_t poolOffset(uint8_t cls) {
+    return cls == 0 ? 0 : poolOffset(cls - 1) + (uint32_t)poolClasses[cls - 1].size * poolClasses[cls - 1].count;
+}
+
+static uint32_t poolMemory[poolOffset(POOL_CLASS_COUNT) / 4];  // 32-bit aligned
+static uint32_t poolUsed[POOL_CLASS_COUNT];  // bitmap of the allocated buffers of each class
+
+tPoolStatistics poolStats;
+
+/*
+    Returns a buffer of at least size bytes or nullptr
+ */
+uint8_t* poolAlloc(uint16_t size) {
+    for (uint8_t cls = 0;  cls < POOL_CLASS_COUNT;  ++cls) {
+        if (poolClasses[cls].size < size)
+            continue;
+
+        for (uint8_t i = 0;  i < poolClasses[cls].count;  ++i) {
+            if (poolUsed[cls] & (1UL << i))
+                continue;
+
+            poolUsed[cls] |= (1UL << i);
+
+            poolStats.allocs++;
+            if (++poolStats.inUse > poolStats.highWater)
+                poolStats.highWater = poolStats.inUse;
+
+            return reinterpret_cast<uint8_t*>(poolMemory) + poolOffset(cls) + (uint32_t)i * poolClasses[cls].size;
+        }
+    }
+
+    // No free buffer in the pool
+    poolStats.failures++;
+    return nullptr;
+}
+
+/*
+    Returns the buffer to the pool, accepts nullptr
+ */
+void poolFree(uint8_t* buf) {
+    uint8_t *mem = reinterpret_cast<uint8_t*>(poolMemory);
+
+    if (buf < mem || buf >= mem + sizeof(poolMemory))
+        return;  // nullptr
+
+    uint32_t offset = buf - mem;
+    uint8_t cls = 0;
+    while (offset >= poolOffset(cls + 1))
+        ++cls;
+
+    poolUsed[cls] &= ~(1UL << ((offset - poolOffset(cls)) / poolClasses[cls].size));
+    poolStats.inUse--;
+}
+
+void printPoolStatistics() {
+    Serial.printf("Pool: %u allocs, %u failed, in use %u, max %u\n", poolStats.allocs, 
+        poolStats.failures, poolStats.inUse, poolStats.highWater);
+}
@@ -0,0 +1,46 @@
+/*
+    Pool of payload buffers reserved at compile time
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _BUFFERPOOL_H_INCLUDED
+#define _BUFFERPOOL_H_INCLUDED
+
+#include "Arduino.h"
+
+// Size classes of the pool { buffer size, number of buffers } sorted by size. The sizes must be
+// multiples of 4, max. 32 buffers in a class. One payload is received at a time, so one buffer of
+// PAYLOAD_CHUNK_SIZE is enough.
+#define BUFFER_POOL_CLASSES  { 256, 1 }
+
+// Pool counters
+typedef struct {
+    uint32_t allocs;      // buffers taken from the pool
+    uint32_t failures;    // failed allocations (pool exhausted or too large request)
+    uint8_t inUse;        // buffers taken from the pool now
+    uint8_t highWater;    // maximum of inUse
+} tPoolStatistics;
+
+extern tPoolStatistics poolStats;
+
+// Prototypes
+uint8_t* poolAlloc(uint16_t size);
+void poolFree(uint8_t* buf);
+void printPoolStatistics();
+
+#endif
@@ -28,19 +28,112 @@
 //#define _DEBUG_SPICALLS
 
 // Global variables
-volatile uint8_t SPISlaveState = (SPISLAVE_RX_READY << 4) | SPISLAVE_TX_NODATA;
-volatile boolean dataReceived = false;
-volatile boolean dataSent = true;
-uint8_t* inputBuffer;
 
-// Reply bufer
-uint8_t reply[32];
+/*
+    The slave state published in the status register is not stored, it is derived from the variables below
+    by refreshStatus(). Every variable has a single writer at any time so the interrupt handlers and the main
+    code never need to disable interrupts:
+    - receiver: rxHead, rxAckHead (and rxNak or rxErrorsSeen) are written by the interrupt handlers, rxTail
+      (and rxChecked, rxBadFrame, rxErrors) by the main code
+    - transmitter: while txActive is false the main code owns txTail and txSent, after setting txActive
+      they are written only by the interrupt handlers until the queue is sent and txActive cleared again
+
+    Protocol modes:
+    - PROTOCOL_MODE_CONFIRM (default): the master confirms every transmitted frame by reading the status
+      register (SPISLAVE_TX_WAITING_FOR_CONFIRM -> next frame or SPISLAVE_TX_NODATA)
+    - PROTOCOL_MODE_CREDIT: reading a frame confirms it and the next queued frame is loaded at once.
+      The reply indicators carry a 4-bit sequence number (MESSAGE_FINISHED_SEQ, MESSAGE_CONTINUES_SEQ).
+      The status low byte has SPISLAVE_STATUS_CREDIT set and the high byte carries the credits instead
+      of the complement of the low byte: free receive slots in the high nibble and queued reply frames
+      in the low nibble. The master may write and read that many frames without reading the status;
+      a repeated sequence number means the frame was read before the next one was loaded.
+
+    Status length:
+    - 2 bytes (default): the state and its complement (or the credits, see above)
+    - 4 bytes: byte 2 is the number of queued reply frames (max. 127) with SPISLAVE_STATUS_BULK set when
+      the last frame of the reply is among them; in PROTOCOL_MODE_CREDIT the master can read them all
+      in one burst. Byte 3 is the socket readiness bitmap (see WiFiSpiEspCommandProcessor::socketStatus).
+
+    Retransmission:
+    - receiving (CHECK_CRC_IN_ISR): a frame with bad crc or lost in a full ring is not acknowledged (NAK),
+      the status shows SPISLAVE_RX_ERROR and the following frames are dropped until the master reads
+      the status. The master then resends the frames from the first one not accepted. In
+      PROTOCOL_MODE_CREDIT the high nibble of the error status is the number of frames accepted
+      since the previous status read showing SPISLAVE_RX_READY (rxAckHead), in PROTOCOL_MODE_CONFIRM
+      it is always the last written frame.
+    - receiving (without CHECK_CRC_IN_ISR): the main code checks the stored frames (checkFrames), the status
+      shows SPISLAVE_RX_BUSY until all of them are checked, so a status showing SPISLAVE_RX_READY still
+      acknowledges the frames written before it. A bad frame is reported once by SPISLAVE_RX_ERROR, the frames
+      behind it are dropped when the master reads the error and resends them. The high nibble of the error
+      status is the same as with CHECK_CRC_IN_ISR.
+    - transmitting: the master writes SPISLAVE_REQ_RESEND into the status register when it reads
+      a reply frame with bad crc. The unconfirmed frame is loaded again; in PROTOCOL_MODE_CREDIT the
+      already confirmed frames are taken from the queue slots behind txTail which keep the last
+      transmitted frames until they are reused.
+ */
+
+// Receive frame ring, filled in SPIOnData and drained in readFrame
+uint8_t rxFrames[RX_FRAME_SLOTS][32];
+volatile uint8_t rxHead = 0;  // written only by the interrupt handler
+volatile uint8_t rxTail = 0;  // written only by the main code
+volatile uint8_t rxAckHead = 0;  // rxHead at the last status read showing SPISLAVE_RX_READY, written only by the interrupt handler
+#if defined(CHECK_CRC_IN_ISR)
+volatile boolean rxNak = false;  // a frame was not accepted, written only by the interrupt handlers
+#else
+volatile uint8_t rxChecked = 0;  // the frames before it have a good crc, written only by the main code
+volatile uint8_t rxBadFrame = 0;  // the frame with bad crc, written only by the main code
+volatile uint8_t rxErrors = 0;  // bad frames found, written only by the main code
+volatile uint8_t rxErrorsSeen = 0;  // bad frames reported to the master, written only by the interrupt handlers
+#endif
+volatile uint32_t rxFrameOverflows = 0;  // frames lost because of the full ring
+
+// Transmit frame queue, filled in flush and advanced in SPIOnStatusSent (SPIOnDataSent in PROTOCOL_MODE_CREDIT)
+uint8_t txFrames[TX_FRAME_SLOTS][32];
+volatile uint8_t txHead = 0;  // written only by the main code
+volatile uint8_t txTail = 0;  // written by the interrupt handler while txActive is set
+volatile boolean txActive = false;  // the transmitter is owned by the interrupt handler
+volatile boolean txSent = false;  // the master has read the frame, waiting for confirmation
+volatile boolean txPreparing = false;  // a reply is being prepared, written only by the main code
+volatile boolean txResent = false;  // a resent frame is loaded, written only by the interrupt handlers
+uint8_t txSeq = 0;  // sequence number of the next queued frame (PROTOCOL_MODE_CREDIT)
+
+volatile boolean txReplyQueued = false;  // the last frame of the reply is queued, written only by the main code
+
+// Protocol mode, changed only when the transmitter is idle
+volatile uint8_t protocolMode = PROTOCOL_MODE_CONFIRM;
+
+// Length of the status register [bytes]
+volatile uint8_t statusLength = 2;
+
+// Socket readiness bitmap (status byte 3), written only by the main code
+volatile uint8_t socketReady = 0;
+
+// Incremented on every status register update
+volatile uint8_t statusSeq = 0;
+
+// Reply bufer (points to the txHead slot)
+uint8_t* reply = txFrames[0];
 uint8_t replyPos;
+uint16_t replyCrc;  // crc of the reply frame bytes written so far
+boolean replyAborted = false;  // the reply was dropped, the rest of it is not written until the next replyStart
+
+#if defined(ESPSPI_STATISTICS)
+volatile tSPIStatistics spiStats;
+#endif
 
 // Local prototypes
+int8_t readNextFrame(uint8_t* data, uint8_t &dataPos);
 void writeByte(uint8_t byte);
 void flush(uint8_t indicator);
-uint8_t crc8(uint8_t *buffer, uint8_t bufLen);
+void discardReply();
+void nextTxFrame();
+void resendTxFrame(uint8_t seq);
+#if !defined(CHECK_CRC_IN_ISR)
+void checkFrames();
+#endif
+
+// Keeps the compiler from moving memory accesses across the ring index updates
+#define memoryBarrier()  __asm__ __volatile__ ("" ::: "memory")
 
 /*
    Event: onStatus
@@ -53,9 +146,13 @@ uint8_t crc8(uint8_t *buffer, uint8_t bufLen);
 void ICACHE_RAM_ATTR SPIOnStatus(uint16_t data) {
     #ifdef _DEBUG_SPICALLS
         Serial.printf("Status: %04x\n", data);
-    #else
-        (void)(data);
     #endif
+
+    if ((data & 0xff) == SPISLAVE_REQ_RESEND)
+        resendTxFrame(data >> 8);
+
+    // The master has overwritten the status register, put the slave state back
+    refreshStatus();
 }
 
 
@@ -70,14 +167,31 @@ void ICACHE_RAM_ATTR SPIOnStatusSent() {
         Serial.println(F("Status Sent"));
     #endif
 
-    // querying status after transmitting data confirms the data
-    uint32_t savedPS = noInterrupts();  // cli();
-    if ((SPISlaveState & 0x0f) == SPISLAVE_TX_WAITING_FOR_CONFIRM) {
-        dataSent = true;
-        setTxStatus(SPISLAVE_TX_NODATA);
-    }
+    uint8_t stateRx = (SPISlave.getStatus() >> 4) & 0x03;  // the receiver state the master has read
 
-    xt_wsr_ps(savedPS);  // sei();
+#if defined(CHECK_CRC_IN_ISR)
+    // The master has seen the NAK and resends the frames, accept them again
+    if (rxNak) {
+        rxNak = false;
+        rxAckHead = rxHead;
+        refreshStatus();
+    }
+#else
+    // The master has seen the bad frame and resends it, the frames stored behind it are dropped
+    if (rxErrors != rxErrorsSeen && stateRx == SPISLAVE_RX_ERROR) {
+        rxHead = rxBadFrame;
+        rxAckHead = rxBadFrame;
+        rxErrorsSeen = rxErrors;
+        refreshStatus();
+    }
+#endif
+    // The frames written before are acknowledged
+    else if (stateRx == SPISLAVE_RX_READY)
+        rxAckHead = rxHead;
+
+    // querying status after transmitting data confirms the data (txSent is never set in PROTOCOL_MODE_CREDIT)
+    if (txActive && txSent)
+        nextTxFrame();
 }
 
 
@@ -99,25 +213,59 @@ void ICACHE_RAM_ATTR SPIOnStatusSent() {
 void ICACHE_RAM_ATTR SPIOnData(uint8_t* data, size_t len) {
 	(void)(len);
 
-    // TODO: Fix buffer overwriting when the processing of the buffer is too slow
-  
-    uint32_t savedPS = noInterrupts();  // cli();
+    #if defined(ESPSPI_STATISTICS)
+        uint32_t startCycles = ESP.getCycleCount();
+    #endif
 
-    // Check the CRC
-    setRxStatus(SPISLAVE_RX_CRC_PROCESSING);
+    uint8_t head = rxHead;
 
-    if (data[31] == crc8(data, 31)) {
-        // CRC ok
-        dataReceived = true;
-        setRxStatus(SPISLAVE_RX_BUSY);
-        inputBuffer = data;
+#if defined(CHECK_CRC_IN_ISR)
+    if (rxNak) {
+        // Waiting for the master to resend the frame which was not accepted
+    }
+    else if ((uint8_t)(head - rxTail) >= RX_FRAME_SLOTS) {
+        // No free slot, the master did not wait for SPISLAVE_RX_READY
+        rxFrameOverflows++;
+        rxNak = true;
+    }
+    else if (!frameCrcOk(data)) {
+        // Bad CRC, request the frame again
+        rxNak = true;
+
+        #if defined(ESPSPI_STATISTICS)
+            spiStats.crcErrors++;
+        #endif
+    }
+#else
+    if (rxErrors != rxErrorsSeen) {
+        // Waiting for the master to resend the bad frame
     }
+    else if ((uint8_t)(head - rxTail) >= RX_FRAME_SLOTS) {
+        // No free slot, the master did not wait for SPISLAVE_RX_READY
+        rxFrameOverflows++;
+    }
+#endif
     else {
-        // Bad CRC, ignore the message
-        setRxStatus(SPISLAVE_RX_ERROR);
+        // Store the frame into the ring (the crc is checked in checkFrames without CHECK_CRC_IN_ISR)
+        memcpy(rxFrames[head & (RX_FRAME_SLOTS - 1)], data, 32);
+        memoryBarrier();
+        rxHead = head + 1;
+
+        #if defined(ESPSPI_STATISTICS)
+            spiStats.rxFrames++;
+        #endif
     }
 
-    xt_wsr_ps(savedPS);  // sei();
+    // Reports SPISLAVE_RX_BUSY when the ring is full
+    refreshStatus();
+
+    #if defined(ESPSPI_STATISTICS)
+        uint32_t cycles = ESP.getCycleCount() - startCycles;
+        spiStats.isrCount++;
+        spiStats.isrCycles += cycles;
+        if (cycles > spiStats.isrMaxCycles)
+            spiStats.isrMaxCycles = cycles;
+    #endif
 }
 
 
@@ -129,11 +277,22 @@ void ICACHE_RAM_ATTR SPIOnData(uint8_t* data, size_t len) {
    that buffer can be set with SPISlave.setData
 */
 void ICACHE_RAM_ATTR SPIOnDataSent() {
-    uint32_t savedPS = noInterrupts();  // cli();
-    
-    setTxStatus(SPISLAVE_TX_WAITING_FOR_CONFIRM);
-
-    xt_wsr_ps(savedPS);  // sei();
+    if (txResent) {
+        // The resent frame is read, load the queued frame again (it is read once more
+        // when the main code loaded a new frame meanwhile, the master ignores the repeated sequence number)
+        txResent = false;
+        if (txActive)
+            SPISlave.setData(txFrames[txTail & (TX_FRAME_SLOTS - 1)]);
+        refreshStatus();
+    }
+    else if (txActive) {
+        if (protocolMode == PROTOCOL_MODE_CREDIT)
+            nextTxFrame();  // reading the frame confirms it
+        else {
+            txSent = true;
+            refreshStatus();
+        }
+    }
 
     #ifdef _DEBUG_SPICALLS
         Serial.println(F("Answer Sent"));
@@ -141,65 +300,210 @@ void ICACHE_RAM_ATTR SPIOnDataSent() {
 }
 
 /*
-    Sets receiver status
+    The current frame is confirmed, loads the next queued frame or returns the idle transmitter
+    to the main code.
+    CALLED FROM INTERRUPT
  */
-void ICACHE_RAM_ATTR setRxStatus(uint8_t stateRx) {
-//    uint32_t savedPS = noInterrupts();
-
-    SPISlaveState = (SPISlaveState & 0x0f) | (stateRx << 4);
-    refreshStatus();        
+void ICACHE_RAM_ATTR nextTxFrame() {
+    uint8_t tail = txTail + 1;
+    txTail = tail;
+    txSent = false;
+
+    if (tail != txHead) {
+        // Send next queued frame
+        SPISlave.setData(txFrames[tail & (TX_FRAME_SLOTS - 1)]);
+    }
+    else {
+        // Queue empty, return the transmitter to the main code
+        txActive = false;
+    }
 
-//    xt_wsr_ps(savedPS);
+    refreshStatus();
 }
 
 /*
-    Sets transmitter status
+    Loads the requested frame again into the data buffer (SPISLAVE_REQ_RESEND from the master).
+    In PROTOCOL_MODE_CONFIRM the unconfirmed frame is sent again, seq is ignored. In PROTOCOL_MODE_CREDIT
+    the frame with the sequence number seq is searched in the queue and in the slots behind txTail.
+    The status is refreshed by the caller.
+    CALLED FROM INTERRUPT
  */
-void ICACHE_RAM_ATTR setTxStatus(uint8_t stateTx) {
-//    uint32_t savedPS = noInterrupts();
+void ICACHE_RAM_ATTR resendTxFrame(uint8_t seq) {
+    uint8_t tail = txTail;
 
-    SPISlaveState = (SPISlaveState & 0xf0) | stateTx;
-    refreshStatus();        
-        
-//    xt_wsr_ps(savedPS);
+    if (protocolMode != PROTOCOL_MODE_CREDIT) {
+        if (txActive && txSent) {
+            SPISlave.setData(txFrames[tail & (TX_FRAME_SLOTS - 1)]);
+            txSent = false;
+        }
+        return;
+    }
+
+    // The slot at txHead is being filled by the main code, the frame at txTail is not confirmed yet
+    boolean active = txActive;
+    uint8_t queued = active ? (uint8_t)(txHead - tail) : 0;
+
+    for (uint8_t back = active ? 0 : 1;  back < TX_FRAME_SLOTS - queued;  ++back) {
+        uint8_t *frame = txFrames[(uint8_t)(tail - back) & (TX_FRAME_SLOTS - 1)];
+
+        if ((frame[0] & 0x0f) == seq && (frame[0] & 0xe0) == MESSAGE_FINISHED_SEQ) {
+            SPISlave.setData(frame);
+
+            if (back > 0)
+                txResent = true;
+            return;
+        }
+    }
 }
 
 /*
-    Puts status data into the status register
+    Computes the slave state and puts it into the status register.
+    Can be called both from the main code and from the interrupt handlers. The register write itself
+    is atomic; when an interrupt handler publishes a newer state while the main code is computing its
+    value, the main code detects the changed sequence number and publishes the state again.
  */
 void ICACHE_RAM_ATTR refreshStatus() {
-    uint16_t data = SPISlaveState | ((SPISlaveState ^ 0xff) << 8);
-    SPISlave.setStatus(data);  // Return indicator of the slave state
+    uint8_t seq;
+
+    do {
+        seq = ++statusSeq;
+        memoryBarrier();
+
+        // Every shared variable is read once so the published state and credits are consistent
+        uint8_t head = rxHead;
+        uint8_t rxUsed = head - rxTail;
+        boolean active = txActive;
+        boolean bulk = active && txReplyQueued;
+        memoryBarrier();
+        uint8_t txQueued = active ? (uint8_t)(txHead - txTail) : 0;
+
+        uint8_t stateRx;
+#if defined(CHECK_CRC_IN_ISR)
+        if (rxNak)
+            stateRx = SPISLAVE_RX_ERROR;
+        else if (rxUsed >= RX_FRAME_SLOTS)
+            stateRx = SPISLAVE_RX_BUSY;
+#else
+        if (rxErrors != rxErrorsSeen)
+            stateRx = SPISLAVE_RX_ERROR;
+        else if (rxUsed >= RX_FRAME_SLOTS || rxChecked != head)
+            stateRx = SPISLAVE_RX_BUSY;  // full or the frames not checked yet
+#endif
+        else
+            stateRx = SPISLAVE_RX_READY;
+
+        uint8_t stateTx;
+        if (txResent)
+            stateTx = SPISLAVE_TX_READY;
+        else if (active)
+            stateTx = txSent ? SPISLAVE_TX_WAITING_FOR_CONFIRM : SPISLAVE_TX_READY;
+        else
+            stateTx = txPreparing ? SPISLAVE_TX_PREPARING_DATA : SPISLAVE_TX_NODATA;
+
+        uint8_t state = (stateRx << 4) | stateTx;
+        uint32_t data;
+        if (protocolMode == PROTOCOL_MODE_CREDIT) {
+            uint8_t rxFree = RX_FRAME_SLOTS - rxUsed;
+            if (stateRx == SPISLAVE_RX_ERROR) {
+                // Frames accepted before the NAK
+#if defined(CHECK_CRC_IN_ISR)
+                rxFree = head - rxAckHead;
+#else
+                rxFree = rxBadFrame - rxAckHead;
+#endif
+            }
+            data = state | SPISLAVE_STATUS_CREDIT | (min(rxFree, (uint8_t)15) << 12) | (min(txQueued, (uint8_t)15) << 8);
+        }
+        else
+            data = state | ((state ^ 0xff) << 8);
+
+        if (statusLength == 4) {
+            // Reply length hint
+            data |= (uint32_t)((bulk ? SPISLAVE_STATUS_BULK : 0) | min(txQueued, (uint8_t)127)) << 16;
+            // Sockets needing attention
+            data |= (uint32_t)socketReady << 24;
+        }
+
+        SPISlave.setStatus(data);  // Return indicator of the slave state
+
+        memoryBarrier();
+    } while (seq != statusSeq);
+}
+
+/*
+    Switches the length of the status register (2 or 4 bytes), the new length applies from the next
+    status read.
+ */
+void setStatusLength(uint8_t len) {
+    statusLength = len;
+    SPISlave.setStatusLength(len);
+    refreshStatus();
+}
+
+/*
+    Publishes the socket readiness bitmap in the 4 byte status
+ */
+void setSocketStatus(uint8_t bits) {
+    if (bits != socketReady) {
+        socketReady = bits;
+        refreshStatus();
+    }
+}
+
+/*
+    Switches the protocol mode, drops the unsent reply and restarts the frame numbering.
+    The reply to the command switching the mode is sent already in the new mode.
+ */
+void setProtocolMode(uint8_t mode) {
+    discardReply();
+
+    protocolMode = mode;
+    txSeq = 0;
+    refreshStatus();
+}
+
+/*
+    Announces a reply that takes some time to prepare (SPISLAVE_TX_PREPARING_DATA)
+ */
+void replyPrepare() {
+    discardReply();
+
+    txPreparing = true;
+    refreshStatus();
 }
 
 /*
  * 
  */
 void replyStart(const uint8_t cmd, const uint8_t numParams) {
+    discardReply();  // discard previous message (when master sends a new command it is clear it does not care about a previous one)
+    replyAborted = false;
+
     reply[1] = START_CMD;
     reply[2] = cmd | REPLY_FLAG;
     reply[3] = numParams;  // number of params
 
     replyPos = 3;
-
-    dataSent = true;  // discard previous message (when master sends a new command it is clear it does not care about a previous one)
+    replyCrc = frameCrcUpdate(0, reply + 1, 3);
 }
 
 void replyParam(const uint8_t* param, const uint8_t paramLen) {
     writeByte(paramLen);
-    
-    for (uint8_t i=0;  i<paramLen;  ++i) {
-        writeByte(*param++);
-    }
+    writeBytes(param, paramLen);
 }
 
 void replyParam16(const uint8_t* param, const uint16_t paramLen) {
-    writeByte(paramLen >> 8);
-    writeByte(paramLen & 0xff);
-    
-    for (uint16_t i=0;  i<paramLen;  ++i) {
-        writeByte(*param++);
-    }
+    replyParam16Header(paramLen);
+    writeBytes(param, paramLen);
+}
+
+/*
+    Writes only the length of a 16 bit parameter, the paramLen bytes of the value must follow
+ */
+void replyParam16Header(const uint16_t paramLen) {
+    uint8_t len[2] = { (uint8_t)(paramLen >> 8), (uint8_t)(paramLen & 0xff) };
+
+    writeBytes(len, 2);
 }
 
 void replyEnd() {
@@ -207,29 +511,111 @@ void replyEnd() {
     flush(MESSAGE_FINISHED);
 }
 
+/*
+    Drops the reply being written, e.g. when the master does not read it
+ */
+void replyAbort() {
+    discardReply();
+    replyAborted = true;
+
+    txPreparing = false;
+    refreshStatus();
+}
+
+/*
+    Returns the number of bytes that can be written into the reply now. The transmit queue holds
+    TX_FRAME_SLOTS - TX_RESEND_SLOTS frames, the longer replies are written by parts as the master
+    reads the queued frames.
+ */
+uint16_t replySpace() {
+    uint8_t queued = txHead - txTail;
+    if (replyAborted || queued >= TX_FRAME_SLOTS - TX_RESEND_SLOTS)
+        return 0;
+
+    // The free frames including the one being written
+    uint8_t space = frameCheckPos - 1;
+    return (TX_FRAME_SLOTS - TX_RESEND_SLOTS - queued) * space - replyPos;
+}
+
 void writeByte(const uint8_t b) {
-    if (replyPos >= 30) {
+    writeBytes(&b, 1);
+}
+
+/*
+    Appends len bytes to the reply, the data are copied in contiguous segments of the frames
+ */
+void writeBytes(const uint8_t* buf, uint16_t len) {
+    while (len > 0) {
+        uint8_t n;
+        uint8_t* dest = writeReserve(n);
+        if (n > len)
+            n = len;
+
+        memcpy(dest, buf, n);
+        writeCommit(n);
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+    Returns the free part of the current reply frame (len bytes, at least one) for writing the data
+    in place. The frame is sent first when it is full. The written bytes are added by writeCommit.
+ */
+uint8_t* writeReserve(uint8_t &len) {
+    uint8_t space = frameCheckPos - 1;  // the frame data without the indicator
+    if (replyAborted) {
+        // The data are written into the unused frame and thrown away
+        len = space;
+        return reply + 1;
+    }
+
+    if (replyPos >= space) {
         // Buffer full - send it now
         flush(MESSAGE_CONTINUES);
+
+        if (replySpace() == 0) {
+            // The reply does not fit into the transmit queue and was not written by parts (see replySpace)
+            replyAbort();
+            len = space;
+            return reply + 1;
+        }
     }
-        
-    reply[++replyPos] = b;
+
+    len = space - replyPos;
+    return reply + replyPos + 1;
+}
+
+/*
+    Adds len bytes written into the space returned by writeReserve to the reply
+ */
+void writeCommit(uint8_t len) {
+    if (replyAborted)
+        return;
+
+    replyCrc = frameCrcUpdate(replyCrc, reply + replyPos + 1, len);
+    replyPos += len;
 }
 
 void flush(uint8_t indicator) {
-    // Is buffer empty?
-    if (replyPos == 0)
+    // Is buffer empty or the reply dropped?
+    if (replyPos == 0 || replyAborted)
         return;  
 
     // Message indicator
-    reply[0] = indicator;
+    if (protocolMode == PROTOCOL_MODE_CREDIT)
+        reply[0] = (indicator == MESSAGE_FINISHED ? MESSAGE_FINISHED_SEQ : MESSAGE_CONTINUES_SEQ) | (txSeq++ & 0x0f);
+    else
+        reply[0] = indicator;
 
     // Pad the data with zeros
-    while (replyPos < 30)
-        reply[++replyPos] = 0;
+    uint8_t pad = frameCheckPos - 1 - replyPos;
+    memset(reply + replyPos + 1, 0, pad);
+    replyCrc = frameCrcUpdate(replyCrc, reply + replyPos + 1, pad);
+    replyPos += pad;
 
     // CRC
-    reply[31] = crc8(reply, 31);
+    frameCrcPut(reply, replyCrc);
 
     // Debugging printout
     #ifdef _DEBUG_MESSAGES
@@ -242,79 +628,208 @@ void flush(uint8_t indicator) {
         Serial.flush();
     #endif
 
-    // Wait until the previous message was sent
-    uint32_t thisTime = millis();
+    // Queue the frame
+    memoryBarrier();
+    uint8_t head = txHead + 1;
+    txHead = head;
+    memoryBarrier();
+    if (indicator == MESSAGE_FINISHED)
+        txReplyQueued = true;
+
+    // The rest of the reply follows, SPISLAVE_TX_PREPARING_DATA when the queue runs empty before
+    txPreparing = (indicator != MESSAGE_FINISHED);
+
+    if (!txActive) {
+        // The transmitter is idle, send the frame now and hand the transmitter over to the interrupt handler
+        SPISlave.setData(reply);
+        txSent = false;
+        memoryBarrier();
+        txActive = true;
+    }
+    refreshStatus();  // publishes the number of queued frames
 
-    while (!dataSent && (millis() - thisTime < 1000));
+    #if defined(ESPSPI_STATISTICS)
+        spiStats.txFrames++;
+    #endif
 
-    // Send the buffer
-    uint32_t savedPS = noInterrupts();  // cli();
+    replyPos = 0;
+    replyCrc = 0;
 
-    dataSent = false;
-    SPISlave.setData(reply);
-    setTxStatus(SPISLAVE_TX_READY);
+    // The next frame, written only when the queue has a free slot (see replySpace), the last sent
+    // frames are kept for resending
+    reply = txFrames[head & (TX_FRAME_SLOTS - 1)];
+}
 
-    xt_wsr_ps(savedPS);  // sei();
+/*
+    Stops the transmitter and empties the transmit queue
+ */
+void discardReply() {
+    txActive = false;  // take the transmitter back from the interrupt handler
+    memoryBarrier();
+    txTail = txHead;
+    txSent = false;
+    txReplyQueued = false;
+    refreshStatus();
 
     replyPos = 0;
+    replyCrc = 0;
+    reply = txFrames[txHead & (TX_FRAME_SLOTS - 1)];
 }
 
+#if !defined(CHECK_CRC_IN_ISR)
 /*
-    Reads a byte from the input buffer, waits for another data chunk if necessary.
+    Checks the crc of the frames stored since the last call. The first bad frame is reported to the master,
+    the frames are not checked further until the master has read the error.
+ */
+void checkFrames() {
+    uint8_t checked = rxChecked;
+
+    if (rxErrors != rxErrorsSeen || checked == rxHead)
+        return;  // Waiting for the master to resend the bad frame or no new frame
+
+    do {
+        if (!frameCrcOk(rxFrames[checked & (RX_FRAME_SLOTS - 1)])) {
+            rxBadFrame = checked;
+            memoryBarrier();
+            rxErrors++;
+
+            #if defined(ESPSPI_STATISTICS)
+                spiStats.crcErrors++;
+            #endif
+            break;
+        }
+        rxChecked = ++checked;
+    } while (checked != rxHead);
+
+    // Publishes the receiver ready or the error
+    refreshStatus();
+}
+#endif
+
+/*
+    Takes the oldest received frame from the ring and copies it into data (32 bytes).
+    Returns false when there is no frame waiting.
+ */
+boolean readFrame(uint8_t* data) {
+    uint8_t tail = rxTail;
+
+#if defined(CHECK_CRC_IN_ISR)
+    if (tail == rxHead)
+        return false;  // Ring empty
+#else
+    checkFrames();
+    if (tail == rxChecked)
+        return false;  // No checked frame
+#endif
+
+    memcpy(data, rxFrames[tail & (RX_FRAME_SLOTS - 1)], 32);
+    memoryBarrier();
+    rxTail = tail + 1;  // Release the slot
+
+    // The ring has a free slot now (enables the receiver if it was blocked)
+    refreshStatus();
+
+    return true;
+}
+
+/*
+    Returns the index-th frame waiting in the receive ring or nullptr when there are less frames received
+    (and checked without CHECK_CRC_IN_ISR).
+ */
+const uint8_t* peekFrame(uint8_t index) {
+    uint8_t tail = rxTail;
+
+#if defined(CHECK_CRC_IN_ISR)
+    uint8_t head = rxHead;
+#else
+    checkFrames();
+    uint8_t head = rxChecked;
+#endif
+
+    if ((uint8_t)(head - tail) <= index)
+        return nullptr;
+
+    memoryBarrier();
+    return rxFrames[(uint8_t)(tail + index) & (RX_FRAME_SLOTS - 1)];
+}
+
+/*
+    Replaces the fully read input buffer with the next frame of the message. The message is processed
+    when its frames are in the receive ring (see WiFiSpiEspCommandProcessor::messageReady), so the frame
+    is not waited for.
+    Returns 0 when ok or -1 when error
+ */
+int8_t readNextFrame(uint8_t* data, uint8_t &dataPos) {
+    if (data[0] != MESSAGE_CONTINUES)
+        return -1;  // Error: No more data
+
+    // Read next 32 bytes of the message
+    data[0] = 0;  // invalidate the rx buffer (to be sure it wouldn't be read twice)
+
+    if (!readFrame(data))
+        return -1;  // Error: the message is incomplete
+
+    // Debug printout
+    #ifdef _DEBUG_MESSAGES
+        Serial.print(F("<< "));
+        for (int i=0; i<32; ++i) {
+            Serial.printf("%2x ", data[i]);
+        }
+        Serial.println("");
+    #endif
+
+    // Test
+    if ((data[0] != MESSAGE_FINISHED && data[0] != MESSAGE_CONTINUES)) {
+        Serial.println(F("Invalid message header - message rejected."));
+        return -1;  // Failure - received invalid message
+    }
+    dataPos = 1;
+    return 0;
+}
+
+/*
+    Reads len bytes from the input buffer into buf, takes the next frame of the message if necessary.
+    The data are copied in contiguous segments of the frames. When buf is nullptr, the bytes are skipped.
     Ensures there is at least one byte left in the data buffer.
-    Return the byte read or -1 when error
+    Returns 0 when ok or -1 when error
  */
-int16_t readByte(uint8_t* data, uint8_t &dataPos) {
-    uint8_t b = data[dataPos++];
-
-    // Check the buffer (only 31 bytes available, 32th byte is the crc8)
-    if (dataPos >= 31) {
-        if (data[0] != MESSAGE_CONTINUES)
-            return -1;  // Error: No more data
-
-        // Read next 32 bytes of the message
-        dataReceived = false;
-        data[0] = 0;  // invalidate the rx buffer (to be sure it wouldn't be read twice)
-        setRxStatus(SPISLAVE_RX_READY);
-
-        uint32_t thisTime = millis();
-
-        while (millis() - thisTime < MSG_RECEIVE_TIMEOUT) {
-            if (dataReceived) {
-                // Get the data
-                uint32_t savedPS = noInterrupts();  // cli();
-                dataReceived = false;
-                memcpy(data, inputBuffer, 32);
-                xt_wsr_ps(savedPS);  // sei();
-
-                // Debug printout
-                #ifdef _DEBUG_MESSAGES
-                    Serial.print(F("<< "));
-                    for (int i=0; i<32; ++i) {
-                        Serial.printf("%2x ", data[i]);
-                    }
-                    Serial.println("");
-                #endif
-
-                // Test
-                if ((data[0] != MESSAGE_FINISHED && data[0] != MESSAGE_CONTINUES)) {
-                    Serial.println(F("Invalid message header - message rejected."));
-                    return -1;  // Failure - received invalid message
-                }
-                dataPos = 1;
-                break;
-            }
+int8_t readBytes(uint8_t* data, uint8_t &dataPos, uint8_t* buf, uint16_t len) {
+    while (len > 0) {
+        // Check the buffer (the frame data end at the crc)
+        uint8_t n = frameCheckPos - dataPos;
+        if (n > len)
+            n = len;
+
+        if (buf != nullptr) {
+            memcpy(buf, data + dataPos, n);
+            buf += n;
         }
+        dataPos += n;
+        len -= n;
 
-        if (dataPos != 1)
-            return -1;  // Timeout
+        if (dataPos >= frameCheckPos && readNextFrame(data, dataPos) < 0)
+            return -1;
     }
 
+    return 0;
+}
+
+/*
+    Reads a byte from the input buffer, takes the next frame of the message if necessary.
+    Ensures there is at least one byte left in the data buffer.
+    Return the byte read or -1 when error
+ */
+int16_t readByte(uint8_t* data, uint8_t &dataPos) {
+    uint8_t b;
+
+    if (readBytes(data, dataPos, &b, 1) < 0)
+        return -1;
+
     return (int16_t)b;
 }
 
 /*
-    Reads a parameter from the input buffer, waits for another data chunk if necessary.
+    Reads a parameter from the input buffer, takes the next frame of the message if necessary.
     Ensures there is at least one byte left in the data buffer.
  */
 int8_t getParameter(uint8_t* data, uint8_t &dataPos, uint8_t* param, const uint8_t paramLen) {
@@ -323,44 +838,35 @@ int8_t getParameter(uint8_t* data, uint8_t &dataPos, uint8_t* param, const uint8
         return -1;
     uint8_t len = (b & 0xff);
 
-    for (uint8_t i = 0;  i < len;  ++i)
-    {
-        // Get next character
-        b = readByte(data, dataPos);
-        if (b < 0)
-            return -1;
-        
-        if (i < paramLen)  // don't overrun the buffer
-            *param++ = b;
-    }
+    // Read the part fitting into the buffer, skip the rest (don't overrun the buffer)
+    uint8_t n = (len < paramLen) ? len : paramLen;
+    if (readBytes(data, dataPos, param, n) < 0 || readBytes(data, dataPos, nullptr, len - n) < 0)
+        return -1;
 
     return len;
 }
 
 /*
-    Reads a 16 bit integer parameter from the input buffer, waits for another data chunk if necessary.
+    Reads a 16 bit integer parameter from the input buffer, takes the next frame of the message if necessary.
     Ensures there is at least one byte left in the data buffer.
  */
 int8_t getParameter(uint8_t* data, uint8_t &dataPos, uint16_t* param) {
-    uint16_t p = 0;
+    uint8_t p[2];
     
     int16_t b = readByte(data, dataPos);
     if (b < 0 || (b & 0xff) != 2)
         return -1;
 
     // Get two bytes
-    if ((b = readByte(data, dataPos)) < 0)
-        return -1;
-    p = b << 8;
-    if ((b = readByte(data, dataPos)) < 0)
+    if (readBytes(data, dataPos, p, 2) < 0)
         return -1;
-    *param = p | b;
+    *param = (p[0] << 8) | p[1];
         
     return 2;
 }
 
 /*
-    Reads a string parameter from the input buffer, waits for another data chunk if necessary.
+    Reads a string parameter from the input buffer, takes the next frame of the message if necessary.
     Ensures there is at least one byte left in the data buffer.
  */
 int8_t getParameterString(uint8_t* data, uint8_t &dataPos, char* param, const uint8_t paramLen) {
@@ -374,24 +880,42 @@ int8_t getParameterString(uint8_t* data, uint8_t &dataPos, char* param, const ui
     return len;
 }
 
+#if defined(ESPSPI_STATISTICS)
 /*
- * Compute crc8 with polynom 0x107 (x^8 + x^2 + x + 1)
- * Lookup table idea: https://lentz.com.au/blog/tag/crc-table-generator
+    Prints out frame rates and payload throughput since the last call
  */
-uint8_t ICACHE_RAM_ATTR crc8(uint8_t *buffer, uint8_t bufLen)
-{
-    static const uint8_t PROGMEM tableLow[] = { 0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 
-                                                0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D };
-    static const uint8_t PROGMEM tableHigh[] = { 0x00, 0x70, 0xE0, 0x90, 0xC7, 0xB7, 0x27, 0x57,
-                                                 0x89, 0xF9, 0x69, 0x19, 0x4E, 0x3E, 0xAE, 0xDE };
-
-    uint8_t crcValue = 0x00;
-
-    for (int i = 0; i < bufLen; ++i) {
-        crcValue ^= buffer[i];
-        crcValue = pgm_read_byte(tableLow + (crcValue & 0x0f)) ^ 
-                   pgm_read_byte(tableHigh +((crcValue >> 4) & 0x0f));
+void printSPIStatistics() {
+    static uint32_t lastTime = 0;
+    static uint32_t lastRxFrames = 0;
+    static uint32_t lastTxFrames = 0;
+    static uint32_t lastIsrCount = 0;
+    static uint32_t lastIsrCycles = 0;
+
+    uint32_t now = millis();
+    uint32_t interval = now - lastTime;
+    if (interval == 0)
+        return;
+
+    uint32_t rxRate = (spiStats.rxFrames - lastRxFrames) * 1000 / interval;
+    uint32_t txRate = (spiStats.txFrames - lastTxFrames) * 1000 / interval;
+
+    // Each frame carries 30 (29 with crc16) bytes of payload (indicator and crc excluded)
+    uint8_t payload = frameCheckPos - 1;
+    Serial.printf("SPI rx: %u fr/s %u B/s, tx: %u fr/s %u B/s, crc err: %u, overflows: %u\n",
+        rxRate, rxRate * payload, txRate, txRate * payload, spiStats.crcErrors, rxFrameOverflows);
+
+    // Duration of the receive interrupt handler
+    uint32_t isrCount = spiStats.isrCount - lastIsrCount;
+    if (isrCount > 0) {
+        Serial.printf("SPI rx isr: avg %u, max %u cycles\n", 
+            (spiStats.isrCycles - lastIsrCycles) / isrCount, spiStats.isrMaxCycles);
     }
 
-    return crcValue;
+    lastTime = now;
+    lastRxFrames = spiStats.rxFrames;
+    lastTxFrames = spiStats.txFrames;
+    lastIsrCount = spiStats.isrCount;
+    lastIsrCycles = spiStats.isrCycles;
+    spiStats.isrMaxCycles = 0;
 }
+#endif
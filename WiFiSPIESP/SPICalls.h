@@ -25,6 +25,7 @@
 #define _SPICALLS_H_INCLUDED
 
 #include "Arduino.h"
+#include "SPIFrameCheck.h"
 
 // Prints out debugging information
 //#define _DEBUG
@@ -32,21 +33,64 @@
 //#define _DEBUG_MESSAGES
 
 #define ESPSPI_MONITOR
+// Collects SPI frame and command timing statistics, printed out together with the monitor data
+//#define ESPSPI_STATISTICS
+// Checks the crc of received frames in the interrupt handler. Without it (NO_CHECK_CRC_IN_ISR) the handler
+// only stores the frame and the crc is checked in the main code: shorter time in the interrupt handler,
+// but the receiver is busy until the main code has checked the frames. Bad frames are resent either way.
+#if !defined(NO_CHECK_CRC_IN_ISR)
+#define CHECK_CRC_IN_ISR
+#endif
+
+// Number of receive frame slots (power of 2, max. 128)
+#define RX_FRAME_SLOTS  8
+// Number of transmit frame slots (power of 2, max. 128)
+#define TX_FRAME_SLOTS  16
+// Number of transmitted frames kept in the transmit slots for resending (PROTOCOL_MODE_CREDIT)
+#define TX_RESEND_SLOTS  2
 
 // Globals
-extern volatile boolean dataReceived;
-extern uint8_t* inputBuffer;
+extern volatile uint32_t rxFrameOverflows;
+extern volatile uint8_t statusLength;
+
+#if defined(ESPSPI_STATISTICS)
+// SPI frame counters
+typedef struct {
+    uint32_t rxFrames;   // frames stored into the receive ring
+    uint32_t txFrames;   // frames handed over to the master
+    uint32_t crcErrors;  // frames received with a bad crc
+    uint32_t isrCount;   // calls of SPIOnData
+    uint32_t isrCycles;  // total duration of SPIOnData [CPU cycles]
+    uint32_t isrMaxCycles;  // longest SPIOnData since the last printout [CPU cycles]
+} tSPIStatistics;
+
+extern volatile tSPIStatistics spiStats;
+
+void printSPIStatistics();
+#endif
 
 // Prototypes
-void setRxStatus(uint8_t state);
-void setTxStatus(uint8_t state);
 void refreshStatus();
+void setProtocolMode(uint8_t mode);
+void setStatusLength(uint8_t len);
+void setSocketStatus(uint8_t bits);
+
+boolean readFrame(uint8_t* data);
+const uint8_t* peekFrame(uint8_t index);
 
+void replyPrepare();
 void replyStart(const uint8_t cmd, const uint8_t numParams);
 void replyParam(const uint8_t* param, const uint8_t paramLen);
 void replyParam16(const uint8_t* param, const uint16_t paramLen);
+void replyParam16Header(const uint16_t paramLen);
 void replyEnd();
+void replyAbort();
+uint16_t replySpace();
+void writeBytes(const uint8_t* buf, uint16_t len);
+uint8_t* writeReserve(uint8_t &len);
+void writeCommit(uint8_t len);
 
+int8_t readBytes(uint8_t* data, uint8_t &dataPos, uint8_t* buf, uint16_t len);
 int16_t readByte(uint8_t* data, uint8_t &dataPos);
 int8_t getParameter(uint8_t* data, uint8_t &dataPos, uint8_t* param, const uint8_t paramLen);
 int8_t getParameter(uint8_t* data, uint8_t &dataPos, uint16_t* param);
@@ -57,6 +101,8 @@ int8_t getParameterString(uint8_t* data, uint8_t &dataPos, char* param, const ui
 
 // Max waiting time for next chunk of a message
 #define MSG_RECEIVE_TIMEOUT  1000
+// Max waiting time for the master to read the queued reply frames
+#define MSG_SEND_TIMEOUT  1000
 
 // SPI Events
 void SPIOnData(uint8_t* data, size_t len);
@@ -77,6 +123,13 @@ enum {
     SPISLAVE_TX_PREPARING_DATA,
     SPISLAVE_TX_WAITING_FOR_CONFIRM
 };
+// Status format flag (PROTOCOL_MODE_CREDIT)
+#define SPISLAVE_STATUS_CREDIT  0x80
+// Status byte 2 flag: the queued frames complete the reply (4 byte status)
+#define SPISLAVE_STATUS_BULK    0x80
+
+// Requests written by the master into the status register (low byte, the high byte is the argument)
+#define SPISLAVE_REQ_RESEND     0xA5  // send the last reply frame again, argument: frame sequence number
 
 // Command start and end flags
 #define START_CMD   0xE0
@@ -85,5 +138,14 @@ enum {
 // Message indicators
 #define MESSAGE_FINISHED     0xDF
 #define MESSAGE_CONTINUES    0xDC
+// Reply message indicators in PROTOCOL_MODE_CREDIT, the low nibble holds the frame sequence number
+#define MESSAGE_FINISHED_SEQ   0x80
+#define MESSAGE_CONTINUES_SEQ  0x90
+
+// Protocol modes
+enum {
+    PROTOCOL_MODE_CONFIRM,  // every transmitted frame is confirmed by reading the status register
+    PROTOCOL_MODE_CREDIT    // transmitted frames are numbered and confirmed by reading them
+};
 
 #endif
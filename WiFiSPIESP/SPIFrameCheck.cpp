@@ -0,0 +1,129 @@
+/*
+    Integrity check of the SPI frames
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SPIFrameCheck.h"
+
+/*
+    Both crcs start with zero and have no final xor, so they are linear: the crc of a frame is the xor
+    of the crc of its indicator (followed by zeros) and the crc of the remaining bytes. That enables to
+    accumulate the crc while the reply is written and add the indicator, which is known only when
+    the frame is flushed, at the end.
+
+    The lookup tables are generated by the compiler and stay in RAM (not PROGMEM) as they are used
+    in the interrupt handler. The IRAM is not usable for them, it allows only 32-bit reads.
+ */
+
+volatile uint8_t frameCheckMode = FRAME_CHECK_CRC8;
+volatile uint8_t frameCheckPos = 31;
+
+// Shifts n bits (zeros) through the crc register
+constexpr uint8_t crc8Shift(uint8_t crc, int n) {
+    return n == 0 ? crc : crc8Shift((crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1), n - 1);
+}
+
+constexpr uint16_t crc16Shift(uint16_t crc, int n) {
+    return n == 0 ? crc : crc16Shift((crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1), n - 1);
+}
+
+#define CRC8_1(i)    crc8Shift(i, 8)
+#define CRC8_4(i)    CRC8_1(i), CRC8_1(i + 1), CRC8_1(i + 2), CRC8_1(i + 3)
+#define CRC8_16(i)   CRC8_4(i), CRC8_4(i + 4), CRC8_4(i + 8), CRC8_4(i + 12)
+#define CRC8_64(i)   CRC8_16(i), CRC8_16(i + 16), CRC8_16(i + 32), CRC8_16(i + 48)
+
+#define CRC16_1(i)   crc16Shift((i) << 8, 8)
+#define CRC16_4(i)   CRC16_1(i), CRC16_1(i + 1), CRC16_1(i + 2), CRC16_1(i + 3)
+#define CRC16_16(i)  CRC16_4(i), CRC16_4(i + 4), CRC16_4(i + 8), CRC16_4(i + 12)
+#define CRC16_64(i)  CRC16_16(i), CRC16_16(i + 16), CRC16_16(i + 32), CRC16_16(i + 48)
+
+static constexpr uint8_t crc8Table[256] = { CRC8_64(0), CRC8_64(64), CRC8_64(128), CRC8_64(192) };
+static constexpr uint16_t crc16Table[256] = { CRC16_64(0), CRC16_64(64), CRC16_64(128), CRC16_64(192) };
+
+// Crc of a single set bit of the indicator followed by the zeros up to the check bytes
+#define CRC8_IND(bit)   crc8Shift(1 << (bit), 8 * 31)
+#define CRC16_IND(bit)  crc16Shift(1 << ((bit) + 8), 8 * 30)
+
+static constexpr uint8_t crc8Indicator[8] = { CRC8_IND(0), CRC8_IND(1), CRC8_IND(2), CRC8_IND(3),
+                                              CRC8_IND(4), CRC8_IND(5), CRC8_IND(6), CRC8_IND(7) };
+static constexpr uint16_t crc16Indicator[8] = { CRC16_IND(0), CRC16_IND(1), CRC16_IND(2), CRC16_IND(3),
+                                                CRC16_IND(4), CRC16_IND(5), CRC16_IND(6), CRC16_IND(7) };
+
+/*
+    Sets the check used for the next frames (both directions). The payload of a frame is 30 bytes
+    with FRAME_CHECK_CRC8 and 29 bytes with FRAME_CHECK_CRC16.
+ */
+void setFrameCheckMode(uint8_t mode) {
+    frameCheckMode = mode;
+    frameCheckPos = (mode == FRAME_CHECK_CRC16 ? 30 : 31);
+}
+
+/*
+    Adds len bytes to the crc, the bytes of a frame starting at position 1
+ */
+uint16_t ICACHE_RAM_ATTR frameCrcUpdate(uint16_t crc, const uint8_t *buf, uint8_t len) {
+    if (frameCheckMode == FRAME_CHECK_CRC16) {
+        while (len-- > 0)
+            crc = (crc << 8) ^ crc16Table[(uint8_t)(crc >> 8) ^ *buf++];
+    }
+    else {
+        uint8_t crc8 = crc;
+        while (len-- > 0)
+            crc8 = crc8Table[crc8 ^ *buf++];
+        crc = crc8;
+    }
+
+    return crc;
+}
+
+/*
+    Completes the crc of frame bytes 1 to the end of data with the indicator (byte 0) and stores it
+    into the check bytes
+ */
+void frameCrcPut(uint8_t *frame, uint16_t crc) {
+    uint8_t indicator = frame[0];
+
+    if (frameCheckMode == FRAME_CHECK_CRC16) {
+        for (uint8_t bit = 0;  indicator != 0;  ++bit, indicator >>= 1) {
+            if (indicator & 1)
+                crc ^= crc16Indicator[bit];
+        }
+        frame[30] = crc >> 8;
+        frame[31] = crc & 0xff;
+    }
+    else {
+        for (uint8_t bit = 0;  indicator != 0;  ++bit, indicator >>= 1) {
+            if (indicator & 1)
+                crc ^= crc8Indicator[bit];
+        }
+        frame[31] = crc;
+    }
+}
+
+/*
+    Checks the crc of a received frame
+ */
+boolean ICACHE_RAM_ATTR frameCrcOk(const uint8_t *frame) {
+    uint8_t pos = frameCheckPos;
+    uint16_t crc = frameCrcUpdate(0, frame, pos);
+
+    if (pos == 30)
+        return crc == ((frame[30] << 8) | frame[31]);
+    else
+        return crc == frame[31];
+}
@@ -0,0 +1,43 @@
+/*
+    Integrity check of the SPI frames
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SPIFRAMECHECK_H_INCLUDED
+#define _SPIFRAMECHECK_H_INCLUDED
+
+#include "Arduino.h"
+
+// Frame check modes
+enum {
+    FRAME_CHECK_CRC8,   // byte 31 is the crc8 (polynom 0x107) of bytes 0-30
+    FRAME_CHECK_CRC16   // bytes 30-31 are the crc16 (polynom 0x1021, big endian) of bytes 0-29
+};
+
+// Current mode and the position of the check bytes (end of the frame data)
+extern volatile uint8_t frameCheckMode;
+extern volatile uint8_t frameCheckPos;
+
+// Prototypes
+void setFrameCheckMode(uint8_t mode);
+
+uint16_t frameCrcUpdate(uint16_t crc, const uint8_t *buf, uint8_t len);
+void frameCrcPut(uint8_t *frame, uint16_t crc);
+boolean frameCrcOk(const uint8_t *frame);
+
+#endif
@@ -75,17 +75,25 @@ void SPISlaveClass::begin()
     hspi_slave_onStatusSent(&_s_status_tx);
     hspi_slave_begin(2, this);  // status 2 bytes
 }
-void SPISlaveClass::setData(uint8_t * data, size_t len)
+void ICACHE_RAM_ATTR SPISlaveClass::setData(uint8_t * data, size_t len)
 {
     if(len > 32) {
         len = 32;
     }
     hspi_slave_setData(data, len);
 }
-void ICACHE_RAM_ATTR SPISlaveClass::setStatus(uint16_t status)
+void ICACHE_RAM_ATTR SPISlaveClass::setStatus(uint32_t status)
 {
     hspi_slave_setStatus(status);
 }
+uint32_t ICACHE_RAM_ATTR SPISlaveClass::getStatus()
+{
+    return hspi_slave_getStatus();
+}
+void SPISlaveClass::setStatusLength(uint8_t len)
+{
+    hspi_slave_setStatusLength(len);
+}
 void SPISlaveClass::onData(void (*cb)(uint8_t *data, size_t len))
 {
     _data_cb = cb;
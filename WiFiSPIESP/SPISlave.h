@@ -54,7 +54,9 @@ public:
     ~SPISlaveClass() {}
     void begin();
     void setData(uint8_t * data, size_t len = 32);
-    void setStatus(uint16_t status);
+    void setStatus(uint32_t status);
+    uint32_t getStatus();
+    void setStatusLength(uint8_t len);
 
     void onData(void (*cb)(uint8_t *data, size_t len));
     void onDataSent(void (*cb)(void));
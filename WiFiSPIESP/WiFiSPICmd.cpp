@@ -22,6 +22,7 @@
 #include "SPICalls.h"
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
+#include <new>
 
 
 // Static private class members
@@ -30,16 +31,186 @@ uint8_t *WiFiSpiEspCommandProcessor::data;
 const char WiFiSpiEspCommandProcessor::INVALID_MESSAGE_HEADER[] PROGMEM = "Invalid message header - message rejected.";
 const char WiFiSpiEspCommandProcessor::INVALID_MESSAGE_BODY[] PROGMEM = "Invalid message body - message rejected.";
 
-// no assumption about MAX_SOCK_NUM value
-WiFiClient *WiFiSpiEspCommandProcessor::clients[MAX_SOCK_NUM];
-WiFiServer *WiFiSpiEspCommandProcessor::servers[MAX_SOCK_NUM];
-WiFiUDP *WiFiSpiEspCommandProcessor::serversUDP[MAX_SOCK_NUM];
-int8_t WiFiSpiEspCommandProcessor::clientsProto[MAX_SOCK_NUM];
+// Socket table
+WiFiSpiEspCommandProcessor::tSocket WiFiSpiEspCommandProcessor::sockets[MAX_SOCKETS];
+
+// Offset of the buffer n in a memory holding the buffers of the sizes one after another
+constexpr uint32_t bufferOffset(const uint16_t *sizes, uint8_t n) {
+    return n == 0 ? 0 : bufferOffset(sizes, n - 1) + sizes[n - 1];
+}
+
+#if defined(SOCKET_RX_BUFFERS)
+// Receive buffers of the sockets, reserved at compile time
+static constexpr uint16_t rxBufferSizes[] = { SOCKET_RX_BUFFER_SIZES };
+static constexpr uint8_t RX_BUFFER_COUNT = sizeof(rxBufferSizes) / sizeof(rxBufferSizes[0]);
+
+static uint8_t rxBufferMemory[bufferOffset(rxBufferSizes, RX_BUFFER_COUNT)];
+#endif
+
+#if defined(SOCKET_TX_BUFFERS)
+// Transmit buffers of the sockets, reserved at compile time
+static constexpr uint16_t txBufferSizes[] = { SOCKET_TX_BUFFER_SIZES };
+static constexpr uint8_t TX_BUFFER_COUNT = sizeof(txBufferSizes) / sizeof(txBufferSizes[0]);
+
+static uint8_t txBufferMemory[bufferOffset(txBufferSizes, TX_BUFFER_COUNT)];
+#endif
 
 // SSL security data
 uint8_t WiFiSpiEspCommandProcessor::SSLFingerprint[20];  // SSL certificate fingerprint
 bool WiFiSpiEspCommandProcessor::useSSLFingerprint = false;
 
+// Payload being received
+WiFiSpiEspCommandProcessor::tPayload WiFiSpiEspCommandProcessor::payload;
+
+// Command waiting for a condition
+WiFiSpiEspCommandProcessor::tWait WiFiSpiEspCommandProcessor::waiting;
+
+// Data reply written by parts
+WiFiSpiEspCommandProcessor::tReplyData WiFiSpiEspCommandProcessor::replyData;
+
+// Command table: command, min and max number of parameters, parameter types, handler
+constexpr WiFiSpiEspCommandProcessor::tCommand WiFiSpiEspCommandProcessor::commands[] PROGMEM = {
+    // ----- GENERAL COMMANDS
+    { GET_FW_VERSION_CMD,         0, 0, { }, cmdGetFwVersion },
+    { GET_MACADDR_CMD,            0, 0, { }, cmdGetMacAddr },
+    { SET_IP_CONFIG_CMD,          5, 5, { PARAM_U32, PARAM_U32, PARAM_U32, PARAM_U32, PARAM_U32 }, cmdSetIpConfig },
+    { START_SCAN_NETWORKS,        0, 0, { }, cmdStartScanNetworks },
+    { SCAN_NETWORKS,              0, 0, { }, cmdScanNetworks },
+    { GET_SCANNED_DATA_CMD,       1, 1, { PARAM_U8 }, cmdGetScannedData },
+    { SOFTWARE_RESET_CMD,         0, 0, { }, cmdSoftwareReset },
+    { GET_PROTOCOL_VERSION_CMD,   0, 0, { }, cmdGetProtocolVersion },
+    { SET_PROTOCOL_MODE_CMD,      1, 1, { PARAM_U8 }, cmdSetProtocolMode },
+    { SET_FRAME_CHECK_CMD,        1, 1, { PARAM_U8 }, cmdSetFrameCheck },
+    { SET_STATUS_LENGTH_CMD,      1, 1, { PARAM_U8 }, cmdSetStatusLength },
+
+    // ----- CONNECTION COMMANDS
+    { GET_CONN_STATUS_CMD,        0, 0, { }, cmdGetConnStatus },
+    { SET_PASSPHRASE_CMD,         2, 2, { PARAM_STRING, PARAM_STRING }, cmdSetPassphrase },
+    { SET_NET_CMD,                1, 1, { PARAM_STRING }, cmdSetNet },
+    { DISCONNECT_CMD,             0, 0, { }, cmdDisconnect },
+    { GET_IPADDR_CMD,             0, 0, { }, cmdGetIpAddr },
+    { GET_CURR_SSID_CMD,          0, 0, { }, cmdGetCurrSsid },
+    { GET_CURR_RSSI_CMD,          0, 0, { }, cmdGetCurrRssi },
+    { GET_CURR_BSSID_CMD,         0, 0, { }, cmdGetCurrBssid },
+    { GET_HOST_BY_NAME_CMD,       1, 1, { PARAM_STRING }, cmdGetHostByName },
+    { SET_SSL_FINGERPRINT_CMD,    0, 1, { PARAM_SHA1 }, cmdSetSSLFingerprint },
+
+    // ----- CLIENT COMMANDS
+    { START_CLIENT_TCP_CMD,       4, 4, { PARAM_U32, PARAM_U16, PARAM_SOCK, PARAM_U8 }, cmdStartClientTcp },
+    { GET_CLIENT_STATE_TCP_CMD,   1, 1, { PARAM_SOCK }, cmdGetClientStateTcp },
+    { AVAIL_DATA_TCP_CMD,         1, 1, { PARAM_SOCK }, cmdAvailDataTcp },
+    { AVAIL_SPACE_TCP_CMD,        1, 1, { PARAM_SOCK }, cmdAvailSpaceTcp },
+    { WAIT_ANY_CMD,               3, 3, { PARAM_U16, PARAM_U8, PARAM_U16 }, cmdWaitAny },
+    { SEND_DATA_TCP_CMD,          2, 2, { PARAM_SOCK, PARAM_DATA }, cmdSendDataTcp },
+    { SET_TCP_COALESCING_CMD,     3, 3, { PARAM_SOCK, PARAM_U16, PARAM_U16 }, cmdSetTcpCoalescing },
+    { FLUSH_DATA_TCP_CMD,         1, 1, { PARAM_SOCK }, cmdFlushDataTcp },
+    { GET_DATA_TCP_CMD,           2, 2, { PARAM_SOCK, PARAM_U8 }, cmdGetDataTcp },
+    { GET_DATABUF_TCP_CMD,        2, 2, { PARAM_SOCK, PARAM_U16 }, cmdGetDatabufTcp },
+    { GET_DATABUF_WAIT_TCP_CMD,   4, 4, { PARAM_SOCK, PARAM_U16, PARAM_U16, PARAM_U16 }, cmdGetDatabufWaitTcp },
+    { STOP_CLIENT_TCP_CMD,        1, 1, { PARAM_SOCK }, cmdStopClientTcp },
+    { VERIFY_SSL_CLIENT_CMD,      3, 3, { PARAM_SHA1, PARAM_STRING, PARAM_SOCK }, cmdVerifySSLClient },
+
+    // ----- SERVER COMMANDS
+    { START_SERVER_TCP_CMD,       3, 3, { PARAM_U16, PARAM_SOCK, PARAM_U8 }, cmdStartServer },  // TCP or UDP
+    { GET_STATE_TCP_CMD,          1, 1, { PARAM_SOCK }, cmdGetStateTcp },
+    { STOP_SERVER_TCP_CMD,        1, 1, { PARAM_SOCK }, cmdStopServer },
+    { GET_REMOTE_DATA_CMD,        1, 1, { PARAM_SOCK }, cmdGetRemoteDataCmd },
+    { GET_SOCKETS_STATE_CMD,      0, 0, { }, cmdGetSocketsState },
+
+    // ----- UDP COMMANDS
+    { BEGIN_UDP_PACKET_CMD,       3, 3, { PARAM_U32, PARAM_U16, PARAM_SOCK }, cmdBeginUdpPacket },
+    { INSERT_DATABUF_CMD,         2, 2, { PARAM_SOCK, PARAM_DATA }, cmdInsertDatabuf },
+    { SEND_DATA_UDP_CMD,          1, 1, { PARAM_SOCK }, cmdSendDataUdp },
+    { UDP_PARSE_PACKET_CMD,       1, 1, { PARAM_SOCK }, cmdUdpParsePacket },
+    { START_SERVER_MULTICAST_CMD, 3, 3, { PARAM_U32, PARAM_U16, PARAM_SOCK }, cmdStartServerMulticast },
+
+    { 0, 0, 0, { }, nullptr }
+};
+
+/*
+    Position of the command cmd in the command table + 1, 0 when it is not there. Evaluated by the compiler.
+ */
+constexpr uint8_t WiFiSpiEspCommandProcessor::commandPosition(uint8_t cmd, uint8_t pos) {
+    return commands[pos].handler == nullptr ? 0 : 
+        (commands[pos].cmd == cmd ? pos + 1 : commandPosition(cmd, pos + 1));
+}
+
+/*
+    Tests whether the identifiers of the commands are lower than COMMAND_ID_LIMIT
+ */
+constexpr bool WiFiSpiEspCommandProcessor::commandIdsValid(uint8_t pos) {
+    return commands[pos].handler == nullptr || (commands[pos].cmd < COMMAND_ID_LIMIT && commandIdsValid(pos + 1));
+}
+
+static_assert(COMMAND_ID_LIMIT == 0x60, "The initializer of the command index covers the identifiers 0x00-0x5F");
+
+#define COMMAND_POSITIONS_8(id) \
+    commandPosition(id), commandPosition(id + 1), commandPosition(id + 2), commandPosition(id + 3), \
+    commandPosition(id + 4), commandPosition(id + 5), commandPosition(id + 6), commandPosition(id + 7)
+
+const uint8_t WiFiSpiEspCommandProcessor::commandIndex[COMMAND_ID_LIMIT] PROGMEM = {
+    COMMAND_POSITIONS_8(0x00), COMMAND_POSITIONS_8(0x08), COMMAND_POSITIONS_8(0x10), COMMAND_POSITIONS_8(0x18),
+    COMMAND_POSITIONS_8(0x20), COMMAND_POSITIONS_8(0x28), COMMAND_POSITIONS_8(0x30), COMMAND_POSITIONS_8(0x38),
+    COMMAND_POSITIONS_8(0x40), COMMAND_POSITIONS_8(0x48), COMMAND_POSITIONS_8(0x50), COMMAND_POSITIONS_8(0x58)
+};
+
+// Parameters of the processed command
+WiFiSpiEspCommandProcessor::tParams WiFiSpiEspCommandProcessor::params;
+
+#if defined(ESPSPI_STATISTICS)
+// Measured commands, the list is terminated by a zero command
+WiFiSpiEspCommandProcessor::tCmdStatistics WiFiSpiEspCommandProcessor::cmdStats[] = {
+    { SEND_DATA_TCP_CMD, 0, 0, 0 },
+    { GET_DATABUF_TCP_CMD, 0, 0, 0 },
+    { GET_DATABUF_WAIT_TCP_CMD, 0, 0, 0 },
+    { BEGIN_UDP_PACKET_CMD, 0, 0, 0 },
+    { INSERT_DATABUF_CMD, 0, 0, 0 },
+    { SEND_DATA_UDP_CMD, 0, 0, 0 },
+    { UDP_PARSE_PACKET_CMD, 0, 0, 0 },
+    { WAIT_ANY_CMD, 0, 0, 0 },
+    { 0, 0, 0, 0 }
+};
+
+uint32_t WiFiSpiEspCommandProcessor::cmdStartTime;
+#endif
+
+/*
+    Tests whether the next message in the receive ring can be processed without waiting for more frames.
+    The multi-frame messages are processed only after all their frames have been received, except for 
+    the commands with a PARAM_DATA parameter which process their payload frame by frame. A message
+    longer than the ring is rejected by processCommand when the ring is full.
+ */
+bool WiFiSpiEspCommandProcessor::messageReady() {
+    const uint8_t *frame = peekFrame(0);
+
+    if (frame == nullptr || waiting.complete != nullptr || replyData.pending)
+        return false;  // Nothing received or the reply of the previous command is pending
+    
+    if (payload.complete != nullptr || frame[0] != MESSAGE_CONTINUES)
+        return true;  // Single frame message or next part of a payload
+
+    tCommand command;
+    if (frame[1] == START_CMD && findCommand(frame[2], command) && hasPayload(&command))
+        return true;  // The payload is received frame by frame
+
+    return messageInRing(1) || peekFrame(RX_FRAME_SLOTS - 1) != nullptr;
+}
+
+/*
+    Tests whether the last frame of the message is in the receive ring, the frames before the index-th
+    waiting frame are already known to continue the message
+ */
+bool WiFiSpiEspCommandProcessor::messageInRing(uint8_t index) {
+    const uint8_t *frame;
+
+    for (;  (frame = peekFrame(index)) != nullptr;  ++index) {
+        if (frame[0] != MESSAGE_CONTINUES)
+            return true;  // Last frame of the message received
+    }
+
+    return false;
+}
+
 /*
     Processes the input buffer for a command.
  */
@@ -57,6 +228,25 @@ void WiFiSpiEspCommandProcessor::processCommand(uint8_t *dataIn) {
         Serial.println("");
     #endif
 
+    // Next frame of a payload
+    if (payload.complete != nullptr) {
+        if (data[0] != MESSAGE_FINISHED && data[0] != MESSAGE_CONTINUES) {
+            Serial.println(FPSTR(INVALID_MESSAGE_HEADER));
+            
+            payload.complete(false);
+            payload.complete = nullptr;
+            return;  // Failure - received invalid message
+        }
+
+        receivePayload(1);
+
+    #if defined(ESPSPI_STATISTICS)
+        if (payload.complete == nullptr)
+            updateStatistics(payload.cmd);
+    #endif
+        return;
+    }
+
     // Decode the buffer
     if ((data[0] != MESSAGE_FINISHED && data[0] != MESSAGE_CONTINUES) || data[1] != START_CMD) {
         Serial.println(FPSTR(INVALID_MESSAGE_HEADER));
@@ -70,154 +260,895 @@ void WiFiSpiEspCommandProcessor::processCommand(uint8_t *dataIn) {
         return;  // Failure - received invalid message
    }
 
-    // Decode the command
+    // Decode the command (the frame is overwritten when the parameters span more frames)
     uint8_t cmd = data[2];
+    params.cmd = cmd;
 
-    switch (cmd) {
-        // ----- GENERAL COMMANDS
+#if defined(ESPSPI_STATISTICS)
+    cmdStartTime = micros();
+#endif
 
-        case GET_FW_VERSION_CMD:
-            cmdGetFwVersion();  break;
+    // Find the command
+    tCommand command;
 
-        case GET_MACADDR_CMD:
-            cmdGetMacAddr();  break;
-    
-        case SET_IP_CONFIG_CMD:
-            cmdSetIpConfig();  break;
+    if (!findCommand(cmd, command)) {
+        Serial.printf("Unknown command: %2x\n", cmd);
+        return;
+    }
 
-        case START_SCAN_NETWORKS:
-            cmdStartScanNetworks();  break;
+    // The message does not fit into the ring, drop its frames as they come
+    if (data[0] == MESSAGE_CONTINUES && !hasPayload(&command) && !messageInRing(0)) {
+        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
+        skipPayload();
+        return;
+    }
 
-        case SCAN_NETWORKS:
-            cmdScanNetworks();  break;
+    // Validate and decode the parameters, call the handler
+    uint8_t paramBuffer[PARAM_BUFFER_SIZE];
 
-        case GET_SCANNED_DATA_CMD:
-            cmdGetScannedData();  break;
+    if (decodeParams(&command, paramBuffer))
+        command.handler();
+    else if (hasPayload(&command))
+        skipPayload();
 
-        case SOFTWARE_RESET_CMD:
-            cmdSoftwareReset();  break;
-    
-        case GET_PROTOCOL_VERSION_CMD:
-            cmdGetProtocolVersion();  break;
+#if defined(ESPSPI_STATISTICS)
+    // Commands receiving a payload, waiting for data or sending a long reply are finished in next loop() iterations
+    if (payload.complete == nullptr && waiting.complete == nullptr && !replyData.pending)
+        updateStatistics(cmd);
+#endif
+}
 
-        // ----- CONNECTION COMMANDS
+/*
+    Copies the command table entry of cmd from the flash memory into command.
+    Returns false for an unknown command.
+ */
+bool WiFiSpiEspCommandProcessor::findCommand(uint8_t cmd, tCommand &command) {
+    static_assert(commandIdsValid(), "Command identifier out of the index");
 
-        case GET_CONN_STATUS_CMD:
-            cmdGetConnStatus();  break;
-    
-        case SET_PASSPHRASE_CMD:
-            cmdSetPassphrase();  break;
+    if (cmd >= COMMAND_ID_LIMIT)
+        return false;
 
-        case SET_NET_CMD:
-            cmdSetNet();  break;
+    uint8_t pos = pgm_read_byte(&commandIndex[cmd]);
+    if (pos == 0)
+        return false;
 
-        case DISCONNECT_CMD:
-            cmdDisconnect();  break;
-        
-        case GET_IPADDR_CMD:
-            cmdGetIpAddr();  break; 
+    memcpy_P(&command, &commands[pos - 1], sizeof(command));
+    return true;
+}
 
-        case GET_CURR_SSID_CMD:
-            cmdGetCurrSsid();  break;
+/*
+    Tests whether the command receives a payload (PARAM_DATA parameter)
+ */
+bool WiFiSpiEspCommandProcessor::hasPayload(const tCommand *command) {
+    for (uint8_t i = 0;  i < command->numParams;  ++i) {
+        if (command->params[i] == PARAM_DATA)
+            return true;
+    }
 
-        case GET_CURR_RSSI_CMD:
-            cmdGetCurrRssi();  break;   
+    return false;
+}
 
-        case GET_CURR_BSSID_CMD:
-            cmdGetCurrBssid();  break;
+/*
+    Validates the parameters of the message against the schema of the command and decodes them into
+    buffer (PARAM_BUFFER_SIZE bytes) and params. Reads the next frames of a multi-frame message.
+    Returns false when the message is rejected.
+ */
+bool WiFiSpiEspCommandProcessor::decodeParams(const tCommand *command, uint8_t *buffer) {
+    uint8_t count = data[3];
+    uint8_t dataPos = 4;  // Position in the input buffer
+    uint16_t used = 0;    // Bytes used in the buffer
 
-        case GET_HOST_BY_NAME_CMD:
-            cmdGetHostByName();  break;
+    if (count < command->minParams || count > command->numParams) {
+        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
+        return false;  // Failure - received invalid message
+    }
 
-        case SET_SSL_FINGERPRINT_CMD:
-        	cmdSetSSLFingerprint();  break;
+    params.count = count;
 
-        // ----- CLIENT COMMANDS
-    
-        case START_CLIENT_TCP_CMD:
-            cmdStartClientTcp();  break;
+    for (uint8_t i = 0;  i < count;  ++i) {
+        uint8_t type = command->params[i];
 
-        case GET_CLIENT_STATE_TCP_CMD:
-            cmdGetClientStateTcp();  break;
+        if (type == PARAM_DATA) {
+            // The payload and the end of the message are received by the handler
+            uint8_t len[2];
+            if (readBytes(data, dataPos, len, sizeof(len)) < 0)
+                return false;  // Failure - received invalid parameter
 
-        case AVAIL_DATA_TCP_CMD:
-            cmdAvailDataTcp();  break;
+            params.dataLen = len[0] | (len[1] << 8);
+            params.dataPos = dataPos;
+            return true;
+        }
 
-        case SEND_DATA_TCP_CMD:
-            cmdSendDataTcp();  break;
+        int16_t len = readByte(data, dataPos);
+        if (len < 0)
+            return false;  // Failure - received invalid parameter
 
-        case GET_DATA_TCP_CMD:
-            cmdGetDataTcp();  break;
+        if ((type != PARAM_STRING && len != (type == PARAM_SOCK ? 1 : type)) || used + len + 1 > PARAM_BUFFER_SIZE) {
+            Serial.println(FPSTR(INVALID_MESSAGE_BODY));
+            return false;  // Failure - received invalid parameter
+        }
 
-        case GET_DATABUF_TCP_CMD:
-            cmdGetDatabufTcp();  break;
+        if (readBytes(data, dataPos, buffer + used, len) < 0)
+            return false;  // Failure - received invalid parameter
+        buffer[used + len] = 0;
 
-        case STOP_CLIENT_TCP_CMD:
-            cmdStopClientTcp();  break;
+        if (type == PARAM_SOCK && buffer[used] >= MAX_SOCKETS)
+            return false;  // Invalid socket number
 
-        case VERIFY_SSL_CLIENT_CMD:
-            cmdVerifySSLClient();  break;
-            
-        // ----- SERVER COMMANDS
-    
-        case START_SERVER_TCP_CMD:
-            cmdStartServer();  break;  // TCP or UDP
-    
-        case GET_STATE_TCP_CMD:
-            cmdGetStateTcp();  break;
-       
-        case STOP_SERVER_TCP_CMD:
-            cmdStopServer();  break;
-    
-        case GET_REMOTE_DATA_CMD:
-            cmdGetRemoteDataCmd();  break;
+        params.len[i] = len;
+        params.value[i] = buffer + used;
+        used += len + 1;
+    }
 
+    if (data[dataPos] != END_CMD) {
+        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
+        return false;  // Failure - received invalid message
+    }
 
-        // ----- UDP COMMANDS
-    
-        case BEGIN_UDP_PACKET_CMD:
-            cmdBeginUdpPacket();  break;
-    
-        case INSERT_DATABUF_CMD:
-            cmdInsertDatabuf();  break;
-    
-        case SEND_DATA_UDP_CMD:
-            cmdSendDataUdp();  break;
+    return true;
+}
 
-        case UDP_PARSE_PACKET_CMD:
-            cmdUdpParsePacket();  break;
-            
-        case START_SERVER_MULTICAST_CMD:
-            cmdStartServerMulticast();  break;
+/*
+    Values of the decoded parameters
+ */
+uint8_t WiFiSpiEspCommandProcessor::paramU8(uint8_t i) {
+    return params.value[i][0];
+}
 
-        default:
-            Serial.printf("Unknown command: %2x\n", cmd);
+uint16_t WiFiSpiEspCommandProcessor::paramU16(uint8_t i) {
+    return params.value[i][0] | (params.value[i][1] << 8);
+}
+
+uint32_t WiFiSpiEspCommandProcessor::paramU32(uint8_t i) {
+    uint32_t value;
+    memcpy(&value, params.value[i], sizeof(value));
+    return value;
+}
+
+/*
+    The string is cut to maxLen characters
+ */
+const char *WiFiSpiEspCommandProcessor::paramString(uint8_t i, uint8_t maxLen) {
+    if (params.len[i] > maxLen) {
+        params.len[i] = maxLen;
+        params.value[i][maxLen] = 0;
+    }
+
+    return reinterpret_cast<const char*>(params.value[i]);
+}
+
+#if defined(ESPSPI_STATISTICS)
+/*
+    Adds the processing time of a finished command to its statistics
+ */
+void WiFiSpiEspCommandProcessor::updateStatistics(uint8_t cmd) {
+    // The time spans from the reception of the command to handing over the last reply frame
+    uint32_t duration = micros() - cmdStartTime;
+
+    for (tCmdStatistics *st = cmdStats;  st->cmd != 0;  ++st) {
+        if (st->cmd == cmd) {
+            st->count++;
+            st->totalTime += duration;
+            if (duration > st->maxTime)
+                st->maxTime = duration;
+            break;
+        }
+    }
+}
+
+/*
+    Prints out average and maximum processing time of the measured commands and resets the counters
+ */
+void WiFiSpiEspCommandProcessor::printStatistics() {
+    for (tCmdStatistics *st = cmdStats;  st->cmd != 0;  ++st) {
+        if (st->count == 0)
+            continue;
+
+        Serial.printf("Cmd %02x: %u x, avg %u us, max %u us\n", st->cmd, st->count, 
+            st->totalTime / st->count, st->maxTime);
+
+        st->count = 0;
+        st->totalTime = 0;
+        st->maxTime = 0;
+    }
+}
+#endif
+
+/*
+    Starts reception of a payload of len bytes beginning at data[dataPos]. The function receive is called
+    for every part of the payload as the frames come in (possibly in next loop() iterations), the function
+    complete is called when the message is finished.
+ */
+void WiFiSpiEspCommandProcessor::startPayload(uint8_t dataPos, uint8_t sock, uint16_t len, 
+        void (*receive)(const uint8_t *buf, uint16_t len), void (*complete)(bool ok)) {
+
+    payload.receive = receive;
+    payload.complete = complete;
+    payload.cmd = params.cmd;
+    payload.sock = sock;
+    payload.len = len;
+    payload.received = 0;
+    payload.buffered = 0;
+    payload.written = 0;
+    payload.truncated = false;
+
+    receivePayload(dataPos);
+}
+
+/*
+    Passes the payload part of the current frame to the receive function. Completes the command when 
+    the whole payload and the end of the message (at least one more byte) are received.
+ */
+void WiFiSpiEspCommandProcessor::receivePayload(uint8_t dataPos) {
+    // The frame data end at the crc
+    uint8_t end = frameCheckPos;
+    uint16_t n = payload.len - payload.received;
+    if (n > (uint16_t)(end - dataPos))
+        n = end - dataPos;
+
+    if (n > 0) {
+        payload.receive(data + dataPos, n);
+        payload.received += n;
+        dataPos += n;
+    }
+
+    payload.lastTime = millis();
+
+    if (payload.received < payload.len || dataPos >= end) {
+        if (data[0] == MESSAGE_CONTINUES)
+            return;  // Wait for the next frame
+
+        #ifdef _DEBUG
+            Serial.println(F("Not enough data."));
+        #endif
+    }
+
+    // Finish the command
+    void (*complete)(bool) = payload.complete;
+    payload.complete = nullptr;
+
+    complete(payload.received == payload.len && dataPos < end);
+}
+
+/*
+    Drops the rest of the payload of a rejected command or of a message longer than the receive ring:
+    the frames up to the end of the message are consumed without a reply so they are not taken for
+    new commands
+ */
+void WiFiSpiEspCommandProcessor::skipPayload() {
+    startPayload(frameCheckPos, 0, 0xffff, skipReceive, skipComplete);
+}
+
+void WiFiSpiEspCommandProcessor::skipReceive(const uint8_t *buf, uint16_t len) {
+    (void)buf;
+    (void)len;
+}
+
+void WiFiSpiEspCommandProcessor::skipComplete(bool ok) {
+    (void)ok;
+}
+
+/*
+    Starts a command waiting up to timeout ms for its condition. The function ready tests the condition,
+    the function complete sends the reply (at once when the condition holds, otherwise from poll()).
+    The timeout is limited to MAX_WAIT_TIMEOUT. The parameters of the command are set in waiting by the caller.
+ */
+void WiFiSpiEspCommandProcessor::startWait(uint16_t timeout, bool (*ready)(), void (*complete)()) {
+    waiting.ready = ready;
+    waiting.cmd = params.cmd;
+    waiting.timeout = (timeout > MAX_WAIT_TIMEOUT ? MAX_WAIT_TIMEOUT : timeout);
+    waiting.startTime = millis();
+
+    if (timeout == 0 || ready())
+        complete();
+    else {
+        replyPrepare();  // the master sees SPISLAVE_TX_PREPARING_DATA during the wait
+        waiting.complete = complete;  // Wait in poll()
+    }
+}
+
+/*
+    Sends the reply of the waiting command when its condition holds or when it times out
+ */
+void WiFiSpiEspCommandProcessor::pollWait() {
+    if (!waiting.ready() && millis() - waiting.startTime < waiting.timeout)
+        return;
+
+    void (*complete)() = waiting.complete;
+    waiting.complete = nullptr;
+
+    complete();
+
+#if defined(ESPSPI_STATISTICS)
+    if (!replyData.pending)
+        updateStatistics(waiting.cmd);
+#endif
+}
+
+/*
+    Writes the next part of a data reply when the master has read the queued frames, drops the reply when
+    the master does not read it
+ */
+void WiFiSpiEspCommandProcessor::pollReply() {
+    if (replySpace() > 0)
+        sendDatabuf();
+    else if (millis() - replyData.lastTime >= MSG_SEND_TIMEOUT) {
+        #ifdef _DEBUG
+            Serial.println(F("Reply timeout."));
+        #endif
+
+        replyAbort();
+        replyData.pending = false;
+    }
+
+#if defined(ESPSPI_STATISTICS)
+    if (!replyData.pending)
+        updateStatistics(replyData.cmd);
+#endif
+}
+
+/*
+    Payload receive function, writes the data to the client of payload.sock (to the UDP packet for
+    INSERT_DATABUF_CMD). The parts of the payload are collected in payload.buffer (PAYLOAD_CHUNK_SIZE
+    bytes) to avoid writing each frame separately.
+ */
+void WiFiSpiEspCommandProcessor::receiveIntoClient(const uint8_t *buf, uint16_t len) {
+    while (len > 0) {
+        uint16_t n = PAYLOAD_CHUNK_SIZE - payload.buffered;
+        if (n > len)
+            n = len;
+
+        memcpy(payload.buffer + payload.buffered, buf, n);
+        payload.buffered += n;
+        buf += n;
+        len -= n;
+
+        if (payload.buffered == PAYLOAD_CHUNK_SIZE)
+            flushIntoClient();
+    }
+}
+
+/*
+    Writes the data collected by receiveIntoClient to the client or UDP
+ */
+void WiFiSpiEspCommandProcessor::flushIntoClient() {
+    tSocket &s = sockets[payload.sock];
+    uint16_t len = 0;
+
+    // Only the beginning of the data may be accepted, the reply reports its length
+    if (payload.buffered > 0 && !payload.truncated) {
+        if (payload.cmd == INSERT_DATABUF_CMD) {
+            if (s.type == SOCKET_UDP) {
+                len = s.udp->write(static_cast<const uint8_t*>(payload.buffer), payload.buffered);
+                s.txBytes += len;
+                s.udpTxLen += len;
+            }
+        }
+        else
+            len = socketWrite(payload.sock, payload.buffer, payload.buffered);
+
+        payload.truncated = (len < payload.buffered);
+    }
+
+    payload.written += len;
+
+    payload.buffered = 0;
+}
+
+/*
+    Background tasks, called from loop()
+ */
+void WiFiSpiEspCommandProcessor::poll() {
+#if defined(SOCKET_RX_BUFFERS)
+    // Drain the TCP data into the receive buffers
+    for (uint8_t sock = 0;  sock < MAX_SOCKETS;  ++sock)
+        prefetch(sock);
+#endif
+
+#if defined(SOCKET_TX_BUFFERS)
+    // Write the queued data to the TCP connections
+    for (uint8_t sock = 0;  sock < MAX_SOCKETS;  ++sock)
+        drain(sock);
+#endif
+
+    // Reply to a command waiting for a condition
+    if (waiting.complete != nullptr)
+        pollWait();
+
+    // Next part of a long reply
+    if (replyData.pending)
+        pollReply();
+
+    // Socket readiness (only in the 4 byte status)
+    if (statusLength == 4)
+        setSocketStatus(socketStatus());
+
+    // Cancel a payload when the master stops sending it
+    if (payload.complete != nullptr && millis() - payload.lastTime > MSG_RECEIVE_TIMEOUT) {
+        #ifdef _DEBUG
+            Serial.println(F("Payload timeout."));
+        #endif
+
+        payload.complete(false);
+        payload.complete = nullptr;
     }
 }
 
 /*
     Stops servers and client for the socket sock.
-    Frees server from memory and nulls server pointer.
+    Destroys the server and nulls server pointer.
  */
 void WiFiSpiEspCommandProcessor::stopServer(uint8_t sock) {
-    if (servers[sock] != nullptr) {
-        if (clients[sock] != nullptr) {
-            clients[sock]->stop();
+    if (sockets[sock].type == SOCKET_SERVER) {
+        deleteClient(sock);
+        deleteServer(sock);
+    }
+    else if (sockets[sock].type == SOCKET_UDP) {
+        deleteUdp(sock);
+    }
+}
+
+/*
+    Constructs a client of the socket sock (the previous one must be deleted). A socket without
+    a server or UDP becomes SOCKET_CLIENT.
+ */
+WiFiClient *WiFiSpiEspCommandProcessor::newClient(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    s.client = new (s.clientStorage) WiFiClient();
+    if (s.type == SOCKET_NONE)
+        s.type = SOCKET_CLIENT;
+    return s.client;
+}
+
+/*
+    Constructs a client of the socket sock sharing the connection of client (accepted by a server)
+ */
+WiFiClient *WiFiSpiEspCommandProcessor::newClient(uint8_t sock, const WiFiClient &client) {
+    tSocket &s = sockets[sock];
+
+    s.client = new (s.clientStorage) WiFiClient(client);
+    if (s.type == SOCKET_NONE)
+        s.type = SOCKET_CLIENT;
+    return s.client;
+}
+
+WiFiClientSecure *WiFiSpiEspCommandProcessor::newClientSecure(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    WiFiClientSecure *cliPtr = new (s.clientStorage) WiFiClientSecure();
+    s.client = cliPtr;
+    if (s.type == SOCKET_NONE)
+        s.type = SOCKET_CLIENT;
+    return cliPtr;
+}
+
+/*
+    Stops and destroys the client of the socket sock (if any)
+ */
+void WiFiSpiEspCommandProcessor::deleteClient(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.client == nullptr)
+        return;
+
+#if defined(SOCKET_TX_BUFFERS)
+    // The queued data was already accepted from the master, write it out before closing
+    uint32_t startTime = millis();
+
+    s.txFlush = true;
+    while (s.txCount > 0 && s.client->connected() && millis() - startTime < SOCKET_TX_CLOSE_TIMEOUT) {
+        drain(sock);
+        if (s.txCount > 0)
+            yield();  // let the stack send the data and open the window
+    }
+
+    #ifdef _DEBUG
+        if (s.txCount > 0)
+            Serial.printf("Socket %d closed, %d bytes not sent.\n", sock, s.txCount);
+    #endif
+
+    s.txHead = 0;
+    s.txCount = 0;
+    s.txFlush = false;
+#endif
+
+    s.client->stop();
+    s.client->~WiFiClient();  // virtual, destroys WiFiClientSecure too
+    s.client = nullptr;
+    s.protocol = -1;
+#if defined(SOCKET_RX_BUFFERS)
+    s.rxHead = 0;
+    s.rxCount = 0;  // the rest of the data is dropped with the connection
+#endif
+    if (s.type == SOCKET_CLIENT)
+        s.type = SOCKET_NONE;
+}
+
+WiFiServer *WiFiSpiEspCommandProcessor::newServer(uint8_t sock, uint16_t port) {
+    tSocket &s = sockets[sock];
+
+    s.server = new (s.serverStorage) WiFiServer(port);
+    s.type = SOCKET_SERVER;
+    return s.server;
+}
+
+/*
+    Stops and destroys the server of the socket sock (if any)
+ */
+void WiFiSpiEspCommandProcessor::deleteServer(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.server == nullptr)
+        return;
+
+    s.server->stop();
+    s.server->~WiFiServer();
+    s.server = nullptr;
+    s.type = (s.client != nullptr ? SOCKET_CLIENT : SOCKET_NONE);
+}
+
+WiFiUDP *WiFiSpiEspCommandProcessor::newUdp(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    s.udp = new (s.udpStorage) WiFiUDP();
+    s.udpParsed = false;
+    s.udpRemoteIP = 0;
+    s.udpRemotePort = 0;
+    s.udpTxLen = 0;
+    s.type = SOCKET_UDP;
+    return s.udp;
+}
+
+/*
+    Stops and destroys the UDP of the socket sock (if any)
+ */
+void WiFiSpiEspCommandProcessor::deleteUdp(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.udp == nullptr)
+        return;
+
+    s.udp->stop();
+    s.udp->~WiFiUDP();
+    s.udp = nullptr;
+    s.udpParsed = false;
+    s.udpRemoteIP = 0;
+    s.udpRemotePort = 0;
+    s.type = (s.client != nullptr ? SOCKET_CLIENT : SOCKET_NONE);
+}
+
+/*
+    Returns the number of bytes available for reading from the socket (TCP data or the rest of the UDP packet)
+ */
+int WiFiSpiEspCommandProcessor::socketAvailable(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.type == SOCKET_UDP)
+        return s.udpParsed ? 0 : s.udp->available();  // the packet parsed in advance is not taken over yet
+    else if (s.client != nullptr) {
+#if defined(SOCKET_RX_BUFFERS)
+        return s.rxCount + s.client->available();
+#else
+        return s.client->available();
+#endif
+    }
+    else
+        return 0;
+}
+
+/*
+    Reads up to len bytes from the socket, returns the number of bytes read
+ */
+int WiFiSpiEspCommandProcessor::socketRead(uint8_t sock, uint8_t *buf, uint16_t len) {
+    tSocket &s = sockets[sock];
+    int n = 0;
+
+    if (s.type == SOCKET_UDP)
+        n = s.udpParsed ? 0 : s.udp->read(buf, len);
+    else if (s.client != nullptr) {
+#if defined(SOCKET_RX_BUFFERS)
+        // The buffered data first
+        while (len > 0 && s.rxCount > 0) {
+            uint16_t k = s.rxSize - s.rxHead;  // contiguous part of the ring
+            if (k > s.rxCount)
+                k = s.rxCount;
+            if (k > len)
+                k = len;
 
-            delete clients[sock];
-            clients[sock] = nullptr;
+            memcpy(buf, s.rxBuffer + s.rxHead, k);
+            s.rxHead += k;
+            if (s.rxHead == s.rxSize)
+                s.rxHead = 0;
+            s.rxCount -= k;
+
+            buf += k;
+            len -= k;
+            n += k;
+        }
+
+        if (len > 0 && s.client->available() > 0) {
+            int r = s.client->read(buf, len);
+            if (r > 0)
+                n += r;
         }
-        servers[sock]->stop();
-        
-        delete servers[sock];
-        servers[sock] = nullptr;
+#else
+        n = s.client->read(buf, len);
+#endif
     }
-    else if (serversUDP[sock] != nullptr) {
-        serversUDP[sock]->stop();
-        
-        delete serversUDP[sock];
-        serversUDP[sock] = nullptr;
+
+    if (n > 0)
+        s.rxBytes += n;
+    return n;
+}
+
+/*
+    Returns the next byte of the socket without removing it, -1 if there is none
+ */
+int WiFiSpiEspCommandProcessor::socketPeek(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.type == SOCKET_UDP)
+        return s.udpParsed ? -1 : s.udp->peek();
+    else if (s.client != nullptr) {
+#if defined(SOCKET_RX_BUFFERS)
+        if (s.rxCount > 0)
+            return s.rxBuffer[s.rxHead];
+#endif
+        return s.client->peek();
     }
+    else
+        return -1;
+}
+
+/*
+    Tests whether the client of the socket is connected. A client closed by the peer counts as connected
+    until its data is read out (as WiFiClient::connected() does).
+ */
+bool WiFiSpiEspCommandProcessor::socketConnected(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.client == nullptr)
+        return false;
+
+#if defined(SOCKET_RX_BUFFERS)
+    if (s.rxCount > 0)
+        return true;
+#endif
+    return s.client->connected();
+}
+
+#if defined(SOCKET_RX_BUFFERS)
+/*
+    Moves the data received by the client of the socket into its receive buffer
+ */
+void WiFiSpiEspCommandProcessor::prefetch(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.rxSize == 0 || s.client == nullptr || s.type == SOCKET_UDP)
+        return;
+
+    while (s.rxCount < s.rxSize) {
+        int avail = s.client->available();
+        if (avail <= 0)
+            break;
+
+        uint16_t tail = s.rxHead + s.rxCount;
+        if (tail >= s.rxSize)
+            tail -= s.rxSize;
+
+        // Contiguous free space of the ring
+        uint16_t n = s.rxSize - tail;
+        if (n > s.rxSize - s.rxCount)
+            n = s.rxSize - s.rxCount;
+        if (n > avail)
+            n = avail;
+
+        int r = s.client->read(s.rxBuffer + tail, n);
+        if (r <= 0)
+            break;
+        s.rxCount += r;
+    }
+}
+#endif
+
+/*
+    Writes the data to the client of the socket, returns the number of bytes accepted. With a transmit
+    buffer the data is only queued (as much as fits in) and written later by poll().
+ */
+int WiFiSpiEspCommandProcessor::socketWrite(uint8_t sock, const uint8_t *buf, uint16_t len) {
+    tSocket &s = sockets[sock];
+    int n = 0;
+
+    if (s.client == nullptr)
+        return 0;
+
+#if defined(SOCKET_TX_BUFFERS)
+    if (s.txSize > 0) {
+        if (s.txCount == 0)
+            s.txTime = millis();
+
+        while (len > 0 && s.txCount < s.txSize) {
+            uint16_t tail = s.txHead + s.txCount;
+            if (tail >= s.txSize)
+                tail -= s.txSize;
+
+            // Contiguous free space of the ring
+            uint16_t k = s.txSize - tail;
+            if (k > s.txSize - s.txCount)
+                k = s.txSize - s.txCount;
+            if (k > len)
+                k = len;
+
+            memcpy(s.txBuffer + tail, buf, k);
+            s.txCount += k;
+
+            buf += k;
+            len -= k;
+            n += k;
+        }
+
+        drain(sock);
+    }
+    else
+#endif
+        n = s.client->write(buf, len);
+
+    s.txBytes += n;
+    return n;
+}
+
+/*
+    Returns the number of bytes the socket accepts now without waiting: the free space of the transmit
+    buffer or of the TCP window, for UDP the rest of the packet up to UDP_MAX_PACKET_SIZE
+ */
+uint16_t WiFiSpiEspCommandProcessor::socketSpace(uint8_t sock) {
+    tSocket &s = sockets[sock];
+    size_t space = 0;
+
+    if (s.type == SOCKET_UDP) {
+        if (s.udpTxLen < UDP_MAX_PACKET_SIZE)
+            space = UDP_MAX_PACKET_SIZE - s.udpTxLen;
+    }
+    else if (s.client != nullptr) {
+#if defined(SOCKET_TX_BUFFERS)
+        if (s.txSize > 0)
+            space = s.txSize - s.txCount;
+        else
+#endif
+            space = s.client->availableForWrite();
+    }
+
+    return (space > 0xffff ? 0xffff : space);
+}
+
+#if defined(SOCKET_TX_BUFFERS)
+/*
+    Writes the queued data of the socket to its client, no more than the TCP window takes without waiting.
+    In the coalescing mode the data is held until it reaches coalesceSize, until it is older than
+    coalesceTimeout or until a flush is requested.
+ */
+void WiFiSpiEspCommandProcessor::drain(uint8_t sock) {
+    tSocket &s = sockets[sock];
+
+    if (s.txCount == 0 || s.client == nullptr)
+        return;
+
+    if (s.coalesceSize > 0 && !s.txFlush && s.txCount < s.coalesceSize 
+            && millis() - s.txTime < s.coalesceTimeout)
+        return;  // Wait for more data
+
+    while (s.txCount > 0) {
+        uint16_t n = s.txSize - s.txHead;  // contiguous part of the ring
+        if (n > s.txCount)
+            n = s.txCount;
+
+        size_t space = s.client->availableForWrite();
+        if (space == 0)
+            break;
+        if (n > space)
+            n = space;
+
+        size_t r = s.client->write(s.txBuffer + s.txHead, n);
+        if (r == 0)
+            break;
+
+        s.txHead += r;
+        if (s.txHead == s.txSize)
+            s.txHead = 0;
+        s.txCount -= r;
+    }
+
+    if (s.txCount == 0)
+        s.txFlush = false;
+}
+#endif
+
+/*
+    Returns the state of the server of the socket (tcp_state), CLOSED for a socket without a server
+ */
+uint8_t WiFiSpiEspCommandProcessor::serverState(uint8_t sock) {
+    if (sockets[sock].type != SOCKET_SERVER)
+        return CLOSED;
+
+    return sockets[sock].server->status();
+}
+
+/*
+    Gets the remote IP address and port of the socket (zeros when there is no connection). For UDP it is
+    the sender of the packet taken over by the master, not of a packet parsed in advance.
+ */
+void WiFiSpiEspCommandProcessor::socketRemote(uint8_t sock, uint32_t &ipAddr, uint16_t &port) {
+    tSocket &s = sockets[sock];
+
+    ipAddr = 0;
+    port = 0;
+
+    if (s.type == SOCKET_UDP) {
+        ipAddr = s.udpRemoteIP;  // UDP connection
+        port = s.udpRemotePort;
+    } else if (s.client != nullptr) {
+        ipAddr = s.client->remoteIP();  // TCP connection (server or client)
+        port = s.client->remotePort();
+    }
+}
+
+/*
+    Returns the events of the socket (SOCKET_EVENT_* bits)
+ */
+uint8_t WiFiSpiEspCommandProcessor::socketEvents(uint8_t sock) {
+    tSocket &s = sockets[sock];
+    uint8_t events = 0;
+
+    if (s.type == SOCKET_UDP) {
+        // The next packet is parsed when the current one is read out, UDP_PARSE_PACKET_CMD takes it over
+        if (!s.udpParsed && s.udp->available() <= 0)
+            s.udpParsed = (s.udp->parsePacket() > 0);
+
+        if (s.udpParsed || s.udp->available() > 0)
+            events |= SOCKET_EVENT_READABLE;
+        if (socketSpace(sock) > 0)
+            events |= SOCKET_EVENT_WRITABLE;
+        return events;
+    }
+
+    bool connected = socketConnected(sock);
+    if (s.client != nullptr) {
+        if (socketAvailable(sock) > 0)
+            events |= SOCKET_EVENT_READABLE;
+        else if (!connected)
+            events |= SOCKET_EVENT_CLOSED;  // closed by the peer
+
+        if (connected && socketSpace(sock) > 0)
+            events |= SOCKET_EVENT_WRITABLE;
+    }
+
+    if (s.type == SOCKET_SERVER && !connected && s.server->hasClient())
+        events |= SOCKET_EVENT_ACCEPTED;  // new client
+
+    return events;
+}
+
+/*
+    Computes the socket readiness published in the status register:
+    bit n - socket n has data available (TCP data or a received UDP packet)
+    bit n+4 - socket n needs attention (the peer closed the connection or a new client waits on the server)
+ */
+uint8_t WiFiSpiEspCommandProcessor::socketStatus() {
+    uint8_t bits = 0;
+
+    static_assert(MAX_SOCKETS * 2 <= 8 * sizeof(bits), "The status byte 3 has two bits per socket");
+
+    for (uint8_t sock = 0;  sock < MAX_SOCKETS;  ++sock) {
+        uint8_t events = socketEvents(sock);
+
+        if (events & SOCKET_EVENT_READABLE)
+            bits |= 1 << sock;
+        if (events & (SOCKET_EVENT_CLOSED | SOCKET_EVENT_ACCEPTED))
+            bits |= 0x10 << sock;
+    }
+
+    return bits;
 }
 
 /*
@@ -225,7 +1156,7 @@ void WiFiSpiEspCommandProcessor::stopServer(uint8_t sock) {
  */
 uint8_t WiFiSpiEspCommandProcessor::disconnect() {
     // Stops all servers (TCP and/or UDP)
-    for (uint8_t sock = 0; sock < MAX_SOCK_NUM; ++sock)
+    for (uint8_t sock = 0; sock < MAX_SOCKETS; ++sock)
         stopServer(sock);
     
     // Stops all clients
@@ -252,12 +1183,41 @@ uint8_t WiFiSpiEspCommandProcessor::disconnect() {
     Initializes needed structures
  */
 void WiFiSpiEspCommandProcessor::init() {
-    // Server array initialization
-    for (uint8_t sock=0;  sock<MAX_SOCK_NUM; ++sock) {
-        clients[sock] = nullptr;
-        clientsProto[sock] = -1;
-        servers[sock] = nullptr;
-        serversUDP[sock] = nullptr;
+    // Socket table initialization
+    for (uint8_t sock=0;  sock<MAX_SOCKETS; ++sock) {
+        tSocket &s = sockets[sock];
+
+        s.type = SOCKET_NONE;
+        s.protocol = -1;
+        s.udpParsed = false;
+        s.udpRemoteIP = 0;
+        s.udpRemotePort = 0;
+        s.udpTxLen = 0;
+        s.client = nullptr;
+        s.server = nullptr;
+        s.udp = nullptr;
+        s.txBytes = 0;
+        s.rxBytes = 0;
+
+#if defined(SOCKET_RX_BUFFERS)
+        s.rxBuffer = rxBufferMemory + bufferOffset(rxBufferSizes, sock < RX_BUFFER_COUNT ? sock : RX_BUFFER_COUNT);
+        s.rxSize = (sock < RX_BUFFER_COUNT ? rxBufferSizes[sock] : 0);
+        s.rxHead = 0;
+        s.rxCount = 0;
+#endif
+
+#if defined(SOCKET_TX_BUFFERS)
+        s.txBuffer = txBufferMemory + bufferOffset(txBufferSizes, sock < TX_BUFFER_COUNT ? sock : TX_BUFFER_COUNT);
+        s.txSize = (sock < TX_BUFFER_COUNT ? txBufferSizes[sock] : 0);
+        s.txHead = 0;
+        s.txCount = 0;
+        s.coalesceSize = 0;
+        s.coalesceTimeout = 0;
+        s.txFlush = false;
+#endif
     }
+
+    payload.complete = nullptr;
+    waiting.complete = nullptr;
 }
 
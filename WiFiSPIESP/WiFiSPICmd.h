@@ -23,8 +23,45 @@
 
 #include "Arduino.h"
 #include <ESP8266WiFi.h>
+#include <WiFiClientSecure.h>
 #include "WiFiUdp.h"
 
+// Maximum open connections (sockets), at most 4: the status byte 3 has two bits per socket (WAIT_ANY_CMD
+// would take up to 16). The TCP connections are limited also by the lwIP configuration of the core (MEMP_NUM_TCP_PCB).
+#define MAX_SOCKETS     4
+
+// Receives the TCP data of the sockets in the background into buffers on the ESP, the reads of the master
+// are served from the buffers (optional)
+//#define SOCKET_RX_BUFFERS
+// Sizes of the receive buffers of the sockets 0, 1, ... A socket without a size (or with zero size) has
+// no buffer.
+#define SOCKET_RX_BUFFER_SIZES  1024, 1024, 512, 512
+
+// Queues the data of SEND_DATA_TCP_CMD in transmit buffers on the ESP, the buffers are written to the TCP
+// connections in the background as the window opens (optional)
+//#define SOCKET_TX_BUFFERS
+// Sizes of the transmit buffers of the sockets 0, 1, ... A socket without a size (or with zero size) has
+// no buffer.
+#define SOCKET_TX_BUFFER_SIZES  1024, 1024, 512, 512
+// Max time for writing out the transmit buffer when the connection is being closed [ms]
+#define SOCKET_TX_CLOSE_TIMEOUT  1000
+
+// Max number of parameters of a command
+#define MAX_PARAMS      5
+// Size of the buffer holding the decoded parameters of a command (strings with their terminating zero)
+#define PARAM_BUFFER_SIZE  260
+// Command identifiers are lower than the limit (REPLY_FLAG excluded)
+#define COMMAND_ID_LIMIT   0x60
+
+// Parameter types of the command schemas. The other values are fixed size parameters of that length,
+// the 1, 2 and 4 byte integers are little endian.
+#define PARAM_U8        1
+#define PARAM_U16       2
+#define PARAM_U32       4
+#define PARAM_SHA1      20    // SHA1 fingerprint
+#define PARAM_SOCK      0x80  // socket number, 1 byte lower than MAX_SOCKETS
+#define PARAM_STRING    0x81  // string of any length, terminated by zero when decoded
+#define PARAM_DATA      0x82  // 16 bit length of the payload following the parameter (payload commands)
 
 class WiFiSpiEspCommandProcessor {
     
@@ -36,22 +73,201 @@ class WiFiSpiEspCommandProcessor {
         static const char INVALID_MESSAGE_HEADER[] PROGMEM;  // "Invalid message header - message rejected."
         static const char INVALID_MESSAGE_BODY[] PROGMEM;    // "Invalid message body - message rejected."
 
-        static WiFiClient *clients[MAX_SOCK_NUM];
-        static int8_t clientsProto[MAX_SOCK_NUM];  // Clients protocols (value of enum tProtMode)
-        static WiFiServer *servers[MAX_SOCK_NUM];
-        static WiFiUDP *serversUDP[MAX_SOCK_NUM];
+        // Socket descriptor
+        typedef struct {
+            uint8_t type;         // value of enum tSocketType
+            int8_t protocol;      // client protocol (value of enum tProtMode), -1 = no client
+            bool udpParsed;       // the next packet was parsed in advance by socketEvents(), hidden until UDP_PARSE_PACKET_CMD
+            uint32_t udpRemoteIP; // sender of the packet taken over by UDP_PARSE_PACKET_CMD
+            uint16_t udpRemotePort;
+            uint16_t udpTxLen;    // length of the UDP packet being built (BEGIN_UDP_PACKET_CMD, INSERT_DATABUF_CMD)
+            WiFiClient *client;   // own client (SOCKET_CLIENT) or the client accepted by the server (SOCKET_SERVER)
+            WiFiServer *server;   // SOCKET_SERVER
+            WiFiUDP *udp;         // SOCKET_UDP
+            uint32_t txBytes;     // bytes written to the socket
+            uint32_t rxBytes;     // bytes read from the socket
+
+#if defined(SOCKET_RX_BUFFERS)
+            // Receive ring filled by poll() from the client
+            uint8_t *rxBuffer;
+            uint16_t rxSize;      // 0 = the socket has no buffer
+            uint16_t rxHead;      // position of the first byte
+            uint16_t rxCount;     // number of bytes in the ring
+#endif
+
+#if defined(SOCKET_TX_BUFFERS)
+            // Transmit ring written by poll() to the client
+            uint8_t *txBuffer;
+            uint16_t txSize;      // 0 = the socket has no buffer
+            uint16_t txHead;      // position of the first byte
+            uint16_t txCount;     // number of bytes in the ring
+            uint32_t txTime;      // time when the oldest queued data came [ms]
+            uint16_t coalesceSize;     // data is held until it reaches the size, 0 = written at once
+            uint16_t coalesceTimeout;  // max holding time of the data [ms]
+            bool txFlush;         // write out all the data regardless of coalescing (FLUSH_DATA_TCP_CMD)
+#endif
+
+            // Storage of the objects, reused by the next connections of the socket instead of the heap
+            alignas(WiFiClientSecure) uint8_t clientStorage[sizeof(WiFiClientSecure)];
+            alignas(WiFiServer) uint8_t serverStorage[sizeof(WiFiServer)];
+            alignas(WiFiUDP) uint8_t udpStorage[sizeof(WiFiUDP)];
+        } tSocket;
+
+        static tSocket sockets[MAX_SOCKETS];
 
         // SSL security data
         static uint8_t SSLFingerprint[20];  // SSL certificate fingerprint
         static bool useSSLFingerprint;
 
+        // Payload of a data command received over several loop() iterations
+        typedef struct {
+            void (*receive)(const uint8_t *buf, uint16_t len);  // consumes a part of the payload
+            void (*complete)(bool ok);  // finishes the command, ok is false when the payload is incomplete
+            uint8_t cmd;
+            uint8_t sock;
+            uint8_t *buffer;      // payload buffer (used by receiveIntoClient)
+            uint16_t len;         // payload length
+            uint16_t received;    // number of bytes received
+            uint16_t buffered;    // number of bytes in the buffer not yet written (receiveIntoClient)
+            uint16_t written;     // number of bytes accepted by the client or UDP (receiveIntoClient)
+            bool truncated;       // a part of the data was not accepted, the rest is dropped (receiveIntoClient)
+            uint32_t lastTime;    // reception time of the last frame
+        } tPayload;
+
+        static tPayload payload;
+
+        // Command waiting for a condition, its reply is sent by poll() (GET_DATABUF_WAIT_TCP_CMD, WAIT_ANY_CMD)
+        typedef struct {
+            bool (*ready)();      // tests the condition of the command (the timeout is tested by pollWait)
+            void (*complete)();   // sends the reply, nullptr = no command is waiting
+            uint8_t cmd;
+            uint8_t sock;         // GET_DATABUF_WAIT_TCP_CMD
+            uint16_t len;         // max length of the data (GET_DATABUF_WAIT_TCP_CMD)
+            uint16_t minLen;      // min length of the data available (GET_DATABUF_WAIT_TCP_CMD)
+            uint16_t sockMask;    // tested sockets (WAIT_ANY_CMD)
+            uint8_t events;       // tested events, SOCKET_EVENT_* bits (WAIT_ANY_CMD)
+            uint16_t timeout;     // max wait [ms]
+            uint32_t startTime;   // [ms]
+        } tWait;
+
+        static tWait waiting;
+
+        // Data reply written by parts as the master reads the transmit queue (GET_DATABUF_TCP_CMD), the rest
+        // is written by poll()
+        typedef struct {
+            bool pending;         // a part of the data is not written yet
+            uint8_t cmd;
+            uint8_t sock;
+            uint16_t len;         // bytes not written yet
+            uint32_t lastTime;    // time of the last written part [ms]
+        } tReplyData;
+
+        static tReplyData replyData;
+
+        // Command table entry, the parameters are validated and decoded by decodeParams before the handler
+        // is called
+        typedef struct {
+            uint8_t cmd;
+            uint8_t minParams;    // the parameters after minParams are optional
+            uint8_t numParams;
+            uint8_t params[MAX_PARAMS];  // parameter types (PARAM_*)
+            void (*handler)();
+        } tCommand;
+
+        // The table and its index are constant and kept in the flash memory (PROGMEM)
+        static const tCommand commands[];
+        static const uint8_t commandIndex[COMMAND_ID_LIMIT];  // position of the command in commands + 1, 0 = unknown
+        static constexpr uint8_t commandPosition(uint8_t cmd, uint8_t pos = 0);
+        static constexpr bool commandIdsValid(uint8_t pos = 0);
+
+        // Decoded parameters of the processed command
+        typedef struct {
+            uint8_t cmd;          // command identifier
+            uint8_t count;        // number of parameters received
+            uint8_t len[MAX_PARAMS];
+            uint8_t *value[MAX_PARAMS];  // values in the decoding buffer
+            uint8_t dataPos;      // position of the payload in the frame (PARAM_DATA)
+            uint16_t dataLen;     // payload length (PARAM_DATA)
+        } tParams;
+
+        static tParams params;
+
+#if defined(ESPSPI_STATISTICS)
+        // Processing time of the data transfer commands on the ESP (the master round trip is measured
+        // by the host benchmark, see README)
+        typedef struct {
+            uint8_t cmd;
+            uint32_t count;
+            uint32_t totalTime;  // [us]
+            uint32_t maxTime;    // [us]
+        } tCmdStatistics;
+
+        static tCmdStatistics cmdStats[];
+        static uint32_t cmdStartTime;  // [us]
+
+        static void updateStatistics(uint8_t cmd);
+#endif
+
     public:
         static void init();
+        static void poll();
+        static bool messageReady();
         static void processCommand(uint8_t *dataIn);
+#if defined(ESPSPI_STATISTICS)
+        static void printStatistics();
+#endif
 
     private:
+        static bool findCommand(uint8_t cmd, tCommand &command);
+        static bool hasPayload(const tCommand *command);
+        static bool messageInRing(uint8_t index);
+        static bool decodeParams(const tCommand *command, uint8_t *buffer);
+        static uint8_t paramU8(uint8_t i);
+        static uint16_t paramU16(uint8_t i);
+        static uint32_t paramU32(uint8_t i);
+        static const char *paramString(uint8_t i, uint8_t maxLen = 255);
+
         static uint8_t disconnect();
         static void stopServer(uint8_t sock);
+        static uint8_t socketStatus();
+
+        // Socket objects constructed in the storage reserved for each socket
+        static WiFiClient *newClient(uint8_t sock);
+        static WiFiClient *newClient(uint8_t sock, const WiFiClient &client);
+        static WiFiClientSecure *newClientSecure(uint8_t sock);
+        static void deleteClient(uint8_t sock);
+        static WiFiServer *newServer(uint8_t sock, uint16_t port);
+        static void deleteServer(uint8_t sock);
+        static WiFiUDP *newUdp(uint8_t sock);
+        static void deleteUdp(uint8_t sock);
+
+        static int socketAvailable(uint8_t sock);
+        static int socketRead(uint8_t sock, uint8_t *buf, uint16_t len);
+        static int socketPeek(uint8_t sock);
+        static bool socketConnected(uint8_t sock);
+#if defined(SOCKET_RX_BUFFERS)
+        static void prefetch(uint8_t sock);
+#endif
+        static int socketWrite(uint8_t sock, const uint8_t *buf, uint16_t len);
+        static uint16_t socketSpace(uint8_t sock);
+        static uint8_t socketEvents(uint8_t sock);
+        static uint8_t serverState(uint8_t sock);
+        static void socketRemote(uint8_t sock, uint32_t &ipAddr, uint16_t &port);
+#if defined(SOCKET_TX_BUFFERS)
+        static void drain(uint8_t sock);
+#endif
+
+        static void startPayload(uint8_t dataPos, uint8_t sock, uint16_t len, 
+            void (*receive)(const uint8_t *buf, uint16_t len), void (*complete)(bool ok));
+        static void receivePayload(uint8_t dataPos);
+        static void skipPayload();
+        static void skipReceive(const uint8_t *buf, uint16_t len);
+        static void skipComplete(bool ok);
+        static void startWait(uint16_t timeout, bool (*ready)(), void (*complete)());
+        static void pollWait();
+        static void pollReply();
+        static void receiveIntoClient(const uint8_t *buf, uint16_t len);
+        static void flushIntoClient();
         
         // WiFiSPICmdGeneral.cpp
         static void cmdGetFwVersion();
@@ -62,6 +278,9 @@ class WiFiSpiEspCommandProcessor {
         static void cmdGetScannedData();
         static void cmdSoftwareReset();
         static void cmdGetProtocolVersion();
+        static void cmdSetProtocolMode();
+        static void cmdSetFrameCheck();
+        static void cmdSetStatusLength();
 
         // WiFiSPICmdConnection.cpp
         static void cmdGetConnStatus();
@@ -79,9 +298,22 @@ class WiFiSpiEspCommandProcessor {
         static void cmdStartClientTcp();
         static void cmdGetClientStateTcp();
         static void cmdAvailDataTcp();
+        static void cmdAvailSpaceTcp();
         static void cmdSendDataTcp();
+        static void completeSendDataTcp(bool ok);
+        static void cmdSetTcpCoalescing();
+        static void cmdFlushDataTcp();
         static void cmdGetDataTcp();
         static void cmdGetDatabufTcp();
+        static void cmdGetDatabufWaitTcp();
+        static void replyDatabuf(uint8_t cmd, uint8_t sock, uint16_t len);
+        static void sendDatabuf();
+        static bool readyDatabufWait();
+        static void completeDatabufWait();
+        static void cmdWaitAny();
+        static uint16_t waitAnySockets();
+        static bool readyWaitAny();
+        static void completeWaitAny();
         static void cmdStopClientTcp();
         static void cmdVerifySSLClient();
 
@@ -90,10 +322,12 @@ class WiFiSpiEspCommandProcessor {
         static void cmdGetStateTcp();
         static void cmdStopServer();
         static void cmdGetRemoteDataCmd();
+        static void cmdGetSocketsState();
 
         // WiFiSPICmdUdp.cpp
         static void cmdBeginUdpPacket();
         static void cmdInsertDatabuf();
+        static void completeInsertDatabuf(bool ok);
         static void cmdSendDataUdp();
         static void cmdUdpParsePacket();
         static void cmdStartServerMulticast();
@@ -147,19 +381,42 @@ enum {
   VERIFY_SSL_CLIENT_CMD    = 0x51,
   START_SERVER_MULTICAST_CMD = 0x52,
   SET_SSL_FINGERPRINT_CMD = 0x53,
+  SET_PROTOCOL_MODE_CMD    = 0x54,
+  SET_FRAME_CHECK_CMD      = 0x55,
+  SET_STATUS_LENGTH_CMD    = 0x56,
+  SET_TCP_COALESCING_CMD   = 0x57,
+  FLUSH_DATA_TCP_CMD       = 0x58,
+  AVAIL_SPACE_TCP_CMD      = 0x59,
+  WAIT_ANY_CMD             = 0x5A,
+  GET_SOCKETS_STATE_CMD    = 0x5B,
 
-  // All commands with DATA_FLAG 0x40 send a 16bit Len
+  // Data commands with a 16 bit length: the payload of SEND_DATA_TCP_CMD and INSERT_DATABUF_CMD (PARAM_DATA),
+  // the data in the reply of GET_DATABUF_TCP_CMD and GET_DATABUF_WAIT_TCP_CMD
 
   SEND_DATA_TCP_CMD        = 0x44,
   GET_DATABUF_TCP_CMD      = 0x45,
   INSERT_DATABUF_CMD       = 0x46,
+  GET_DATABUF_WAIT_TCP_CMD = 0x47,
 };
 
 
 // Constants
 
-// Maximum open connections
-#define MAX_SOCK_NUM    4
+// Size of the buffer collecting the data of SEND_DATA_TCP_CMD and INSERT_DATABUF_CMD before it is written
+#define PAYLOAD_CHUNK_SIZE 256
+
+// Socket events (WAIT_ANY_CMD)
+#define SOCKET_EVENT_READABLE   0x01  // data or a UDP packet available
+#define SOCKET_EVENT_WRITABLE   0x02  // space for writing
+#define SOCKET_EVENT_ACCEPTED   0x04  // a new client waits on the server
+#define SOCKET_EVENT_CLOSED     0x08  // the peer closed the connection and all the data was read
+
+// Max wait of GET_DATABUF_WAIT_TCP_CMD and WAIT_ANY_CMD [ms], no other command is processed meanwhile
+#define MAX_WAIT_TIMEOUT  10000
+
+// Max UDP payload sent without IP fragmentation (1500 bytes MTU - IP and UDP headers)
+#define UDP_MAX_PACKET_SIZE  1472
+
 // Size of a MAC-address or BSSID
 #define WL_MAC_ADDR_LENGTH 6
 // Maximum size of a SSID
@@ -178,4 +435,12 @@ typedef enum eProtMode {
     TCP_MODE_WITH_TLS }
 tProtMode;
 
+// Socket types
+typedef enum eSocketType {
+    SOCKET_NONE,
+    SOCKET_CLIENT,   // TCP client (START_CLIENT_TCP_CMD)
+    SOCKET_SERVER,   // TCP server and its accepted client
+    SOCKET_UDP }
+tSocketType;
+
 #endif
@@ -20,6 +20,7 @@
 
 #include "WiFiSPICmd.h"
 #include "SPICalls.h"
+#include "BufferPool.h"
 #include <ESP8266WiFi.h>
 #include <WiFiClientSecure.h>
 
@@ -27,39 +28,14 @@
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdStartClientTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (4 input parameters)
-    if (data[3] != 4) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
-    int32_t ipAddr;
-    uint16_t port;
-    uint8_t sock;
-    uint8_t protocol;  // TCP_MODE or TCP_MODE_WITH_TLS
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&ipAddr), sizeof(ipAddr)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&port), sizeof(port)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &sock, sizeof(sock)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &protocol, sizeof(protocol)) < 0)
-        return;  // Failure - received invalid parameter
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    setTxStatus(SPISLAVE_TX_PREPARING_DATA);
+    int32_t ipAddr = paramU32(0);
+    uint16_t port = paramU16(1);
+    uint8_t sock = paramU8(2);
+    uint8_t protocol = paramU8(3);  // TCP_MODE or TCP_MODE_WITH_TLS
+
+    replyPrepare();
     
     #ifdef _DEBUG
         Serial.printf("WifiClient.connect, sock=%d, ip=%s, port=%d, proto=%d\n", sock, 
@@ -70,28 +46,23 @@ void WiFiSpiEspCommandProcessor::cmdStartClientTcp() {
 #endif
 
     uint8_t status = 0;
-    if (clients[sock] != nullptr) {
-        clients[sock]->stop();
-        delete clients[sock];
-    }
+    deleteClient(sock);
 
     if (protocol == TCP_MODE_WITH_TLS) {
-        WiFiClientSecure *cliPtr = new WiFiClientSecure();
+        WiFiClientSecure *cliPtr = newClientSecure(sock);
 
         // Security settings
         if (useSSLFingerprint)
         	cliPtr->setFingerprint(SSLFingerprint);
         else
         	cliPtr->setInsecure();  // Very insecure, turns off certificate chain validation!
-
-        clients[sock] = cliPtr;
     }
     else {
-        clients[sock] = new WiFiClient();
+        newClient(sock);
     }
-    clientsProto[sock] = protocol;
+    sockets[sock].protocol = protocol;
 
-    status = clients[sock]->connect(IPAddress(ipAddr), port);
+    status = sockets[sock].client->connect(IPAddress(ipAddr), port);
 
 #if defined(ESPSPI_MONITOR)
         Serial.printf(" -> %d\n", status);
@@ -106,37 +77,23 @@ void WiFiSpiEspCommandProcessor::cmdStartClientTcp() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetClientStateTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
     
-    uint8_t status = 0;
-    if (clients[sock] != nullptr)
-        status = clients[sock]->connected();  // 1 = connected
+    tSocket &s = sockets[sock];
+
+    uint8_t status = socketConnected(sock);  // 1 = connected
 
     // Is it a call of a closed client created in a server connection? 
     // Check if the server has connection
-    if (! status && servers[sock] != nullptr) {
-        if (clients[sock] != nullptr) {
-            clients[sock]->stop();
+    if (! status && s.type == SOCKET_SERVER) {
+        deleteClient(sock);
 
-            delete clients[sock];
-            clients[sock] = nullptr;
-            clientsProto[sock] = -1;
-        }
-
-        WiFiClient client = servers[sock]->available(nullptr);
+        WiFiClient client = s.server->available(nullptr);
         status = client.connected();  // 1 = connected
         if (status) {
-            clients[sock] = new WiFiClient(client);  // make a new client only when connected
+            newClient(sock, client);  // make a new client only when connected
         }
     }
     
@@ -149,27 +106,11 @@ void WiFiSpiEspCommandProcessor::cmdGetClientStateTcp() {
  * Works for TCP and UDP connection
  */
 void WiFiSpiEspCommandProcessor::cmdAvailDataTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
-    int16_t avail = 0;
-    
-    if (serversUDP[sock] == nullptr) {
-        if (clients[sock] != nullptr)
-            avail = clients[sock]->available();  // TCP
-    }
-    else {
-        avail = serversUDP[sock]->available();  // UDP 
-    }
+    int16_t avail = socketAvailable(sock);
 
     #ifdef _DEBUG
         Serial.printf("Avail[%d] = %d\n", sock, avail);
@@ -181,111 +122,145 @@ void WiFiSpiEspCommandProcessor::cmdAvailDataTcp() {
 }    
 
 /*
- * 
+    Returns the number of bytes the socket accepts now without waiting (the size of the next write).
+    Works for TCP and UDP connection.
  */
-void WiFiSpiEspCommandProcessor::cmdSendDataTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 2 || data[4] != 1) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+void WiFiSpiEspCommandProcessor::cmdAvailSpaceTcp() {
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
-    uint16_t len = data[6] | (data[7] << 8);
+    uint16_t space = socketSpace(sock);
 
-    // Limit the length to 4000 characters
-    // TODO: Remove the limit
-    if (len > 4000) {
-        #ifdef _DEBUG        
-            Serial.println(F("Too much data (>4000 bytes)."));
-        #endif        
-        return;  // Failure
-    }
+    #ifdef _DEBUG
+        Serial.printf("Space[%d] = %d\n", sock, space);
+    #endif
     
-    uint8_t dataPos = 8;  // Position in the input buffer
+    replyStart(cmd, 1);
+    replyParam(reinterpret_cast<const uint8_t *>(&space), sizeof(space));
+    replyEnd();
+}    
 
-    // Allocate a buffer
-    uint8_t* buffer = static_cast<uint8_t*>(malloc(len));
-    if (buffer == nullptr) {
+/*
+ * 
+ */
+void WiFiSpiEspCommandProcessor::cmdSendDataTcp() {
+    uint8_t sock = paramU8(0);
+    uint16_t len = params.dataLen;
+
+    // Get a buffer for one chunk of the data, without it the payload is dropped and the reply reports
+    // no data written to the client
+    payload.buffer = poolAlloc(PAYLOAD_CHUNK_SIZE);
+    if (payload.buffer == nullptr) {
         #ifdef _DEBUG
-            Serial.printf("Malloc (%d) failed.\n", len);
+            Serial.printf("No buffer (%d).\n", PAYLOAD_CHUNK_SIZE);
         #endif
+        startPayload(params.dataPos, sock, len, skipReceive, completeSendDataTcp);
         return;  // Failure
     }
 
-    // Read input data into the buffer
-    uint8_t* buf = buffer;
-    for (uint16_t i = 0;  i < len;  ++i)
-    {
-        // Get next character
-        int16_t b = readByte(data, dataPos);
-        if (b < 0) {
-            #ifdef _DEBUG
-                Serial.println(F("Not enough data."));
-            #endif
-            return;  // Failure
-        }
-    
-        *buf++ = b;
+    // The data is written to the client by chunks as the frames come in, the reply is sent by completeSendDataTcp
+    startPayload(params.dataPos, sock, len, receiveIntoClient, completeSendDataTcp);
+}    
+
+/*
+    Called when the payload of SEND_DATA_TCP_CMD is received
+ */
+void WiFiSpiEspCommandProcessor::completeSendDataTcp(bool ok) {
+    if (!ok) {
+        poolFree(payload.buffer);
+        return;  // Failure
     }
 
-    if (clients[sock] != nullptr)
-        len = clients[sock]->write(static_cast<const uint8_t*>(buffer), len);
-    else
-        len = 0;
-    free(buffer);
+    // Write the rest of the data
+    flushIntoClient();
+    poolFree(payload.buffer);
 
-    replyStart(cmd, 1);
+    uint16_t len = payload.written;
+
+    replyStart(payload.cmd, 1);
     replyParam(reinterpret_cast<const uint8_t *>(&len), sizeof(len));
     replyEnd();
-}    
+}
+
+/*
+    Sets the coalescing of the data written to the socket: the data is held on the ESP until it reaches
+    size bytes or until it is timeout ms old (or FLUSH_DATA_TCP_CMD comes). Size 0 turns the coalescing off.
+    The setting stays with the socket for its next connections. Returns 1 when the coalescing was set
+    (it needs the transmit buffer of the socket).
+ */
+void WiFiSpiEspCommandProcessor::cmdSetTcpCoalescing() {
+    uint8_t cmd = params.cmd;
+
+    uint8_t status = 0;
+
+#if defined(SOCKET_TX_BUFFERS)
+    uint8_t sock = paramU8(0);
+    uint16_t size = paramU16(1);
+    uint16_t timeout = paramU16(2);
+
+    tSocket &s = sockets[sock];
+
+    if (s.txSize > 0) {
+        if (size > s.txSize)
+            size = s.txSize;  // a full buffer is always written
+
+        s.coalesceSize = size;
+        s.coalesceTimeout = timeout;
+        status = 1;
+    }
+#endif
+
+    replyStart(cmd, 1);
+    replyParam(&status, 1);
+    replyEnd();
+}
+
+/*
+    Writes out the data held by the coalescing of the socket. Returns the number of bytes still queued
+    (waiting for the TCP window).
+ */
+void WiFiSpiEspCommandProcessor::cmdFlushDataTcp() {
+    uint8_t cmd = params.cmd;
+
+    uint16_t queued = 0;
+
+#if defined(SOCKET_TX_BUFFERS)
+    uint8_t sock = paramU8(0);
+    tSocket &s = sockets[sock];
+
+    if (s.txCount > 0) {
+        s.txFlush = true;
+        drain(sock);
+    }
+    queued = s.txCount;
+#endif
+
+    replyStart(cmd, 1);
+    replyParam(reinterpret_cast<const uint8_t *>(&queued), sizeof(queued));
+    replyEnd();
+}
 
 /*
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetDataTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 2 || data[4] != 1 || data[6] != 1 || data[8] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
     
-    uint8_t peek = data[7];
+    uint8_t peek = paramU8(1);
     
     int16_t reply = -1;
-    int16_t avail = 0;
-
-    if (serversUDP[sock] == nullptr) {
-        if (clients[sock] != nullptr)
-            avail = clients[sock]->available();  // TCP
-    }
-    else
-        avail = serversUDP[sock]->available();  // UDP 
 
-    if (avail) {
+    if (socketAvailable(sock) > 0) {
         // Read/peek one character
-         
         if (peek) {
-            if (serversUDP[sock] == nullptr)
-                reply = clients[sock]->peek();
-            else
-                reply = serversUDP[sock]->peek();
+            reply = socketPeek(sock);
         } else {
-            if (serversUDP[sock] == nullptr)
-                reply = clients[sock]->read();
-            else
-                reply = serversUDP[sock]->read();
+            uint8_t b;
+            if (socketRead(sock, &b, 1) == 1)
+                reply = b;
         }
     }
     
@@ -298,69 +273,167 @@ void WiFiSpiEspCommandProcessor::cmdGetDataTcp() {
  *      
  */ 
 void WiFiSpiEspCommandProcessor::cmdGetDatabufTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 2 || data[4] != 1 || data[6] != 2 || data[9] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
     
-    uint16_t len = data[7] | (data[8] << 8);
+    uint16_t len = paramU16(1);
 
-    // Allocate a buffer
-    uint8_t* buffer = static_cast<uint8_t*>(malloc(len));
-    if (buffer == nullptr) {
-        #ifdef _DEBUG
-            Serial.printf("Malloc (%d) failed.\n", len);
-        #endif
-        return;  // Failure
+    replyDatabuf(cmd, sock, len);
+}
+
+/*
+    Reads the data like GET_DATABUF_TCP_CMD but waits up to timeout ms until at least minLen bytes are
+    available or the connection is closed. The reply is sent by poll() so the ESP keeps serving the WiFi
+    and the sockets during the wait.
+ */
+void WiFiSpiEspCommandProcessor::cmdGetDatabufWaitTcp() {
+    uint8_t sock = paramU8(0);
+
+    waiting.sock = sock;
+    waiting.len = paramU16(1);
+    waiting.minLen = paramU16(2);
+
+    if (waiting.minLen > waiting.len)
+        waiting.minLen = waiting.len;
+
+    startWait(paramU16(3), readyDatabufWait, completeDatabufWait);
+}
+
+/*
+    Tests whether the waiting read can be answered: enough data or closed connection
+ */
+bool WiFiSpiEspCommandProcessor::readyDatabufWait() {
+    uint8_t sock = waiting.sock;
+
+    if (socketAvailable(sock) >= waiting.minLen)
+        return true;
+
+    return (sockets[sock].type != SOCKET_UDP && !socketConnected(sock));  // closed, the rest of the data is returned
+}
+
+void WiFiSpiEspCommandProcessor::completeDatabufWait() {
+    replyDatabuf(waiting.cmd, waiting.sock, waiting.len);
+}
+
+/*
+    Waits up to timeout ms until any of the sockets in the mask (bit n = socket n) has any of the events
+    (SOCKET_EVENT_* bits). Returns the mask of the sockets having the events, 0 after the timeout.
+    The reply is sent by poll() like in GET_DATABUF_WAIT_TCP_CMD.
+ */
+void WiFiSpiEspCommandProcessor::cmdWaitAny() {
+    waiting.sockMask = paramU16(0);
+    waiting.events = paramU8(1);
+
+    startWait(paramU16(2), readyWaitAny, completeWaitAny);
+}
+
+/*
+    Returns the mask of the tested sockets having any of the tested events
+ */
+uint16_t WiFiSpiEspCommandProcessor::waitAnySockets() {
+    uint16_t ready = 0;
+
+    static_assert(MAX_SOCKETS <= 8 * sizeof(waiting.sockMask), "WAIT_ANY_CMD has one mask bit per socket");
+
+    for (uint8_t sock = 0;  sock < MAX_SOCKETS;  ++sock) {
+        if ((waiting.sockMask & (1 << sock)) && (socketEvents(sock) & waiting.events))
+            ready |= 1 << sock;
     }
 
-    // Read the data into the buffer
-    if (serversUDP[sock] == nullptr) {
-        if (clients[sock] != nullptr)
-            len = clients[sock]->read(buffer, len);
-        else
-            len = 0;  // no data
-    }
-    else
-        len = serversUDP[sock]->read(buffer, len);
+    return ready;
+}
 
-    replyStart(cmd, 1);
-    replyParam16(buffer, len);
+bool WiFiSpiEspCommandProcessor::readyWaitAny() {
+    return waitAnySockets() != 0;
+}
+
+void WiFiSpiEspCommandProcessor::completeWaitAny() {
+    uint16_t ready = waitAnySockets();
+
+    #ifdef _DEBUG
+        Serial.printf("WaitAny(%04x, %02x) = %04x\n", waiting.sockMask, waiting.events, ready);
+    #endif
+
+    replyStart(waiting.cmd, 1);
+    replyParam(reinterpret_cast<const uint8_t *>(&ready), sizeof(ready));
     replyEnd();
-    
-    free(buffer);
+}
+
+/*
+    Sends the reply of a read: the length (limited to the data available) and up to len bytes of the socket
+ */
+void WiFiSpiEspCommandProcessor::replyDatabuf(uint8_t cmd, uint8_t sock, uint16_t len) {
+    // The length is sent before the data, limit it to the data available
+    int avail = socketAvailable(sock);
+    if (avail < 0)
+        avail = 0;
+    if (len > avail)
+        len = avail;
+
+    replyStart(cmd, 1);
+    replyParam16Header(len);
+
+    replyData.cmd = cmd;
+    replyData.sock = sock;
+    replyData.len = len;
+    replyData.pending = true;
+    replyData.lastTime = millis();
+
+    sendDatabuf();
+}
+
+/*
+    Reads the data directly into the reply frames as far as the transmit queue has space, the rest
+    is written by poll() as the master reads the queued frames
+ */
+void WiFiSpiEspCommandProcessor::sendDatabuf() {
+    uint8_t sock = replyData.sock;
+    uint16_t len = replyData.len;
+
+    while (replySpace() > 0) {
+        if (len == 0) {
+            replyEnd();
+            replyData.pending = false;
+            return;
+        }
+
+        uint8_t n;
+        uint8_t* buffer = writeReserve(n);
+        if (n > len)
+            n = len;
+
+        int r = socketRead(sock, buffer, n);
+        if (r <= 0) {
+            // The data disappeared (connection reset), pad the announced length with zeros
+            #ifdef _DEBUG
+                Serial.println(F("Read failed."));
+            #endif
+            memset(buffer, 0, n);
+            r = n;
+        }
+
+        writeCommit(r);
+        len -= r;
+        replyData.len = len;
+        replyData.lastTime = millis();
+    }
 }
 
 /*
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdStopClientTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (clients[sock] != nullptr) {
-        clients[sock]->stop();
+    uint8_t sock = paramU8(0);
 
-        delete clients[sock];
-        clients[sock] = nullptr;
-        clientsProto[sock] = -1;
-    }
+#if defined(SOCKET_TX_BUFFERS)
+    if (sockets[sock].txCount > 0)
+        replyPrepare();  // writing out the queued data takes time
+#endif
+    
+    deleteClient(sock);
 
     uint8_t status = 0;
     replyStart(cmd, 1);
@@ -373,34 +446,10 @@ void WiFiSpiEspCommandProcessor::cmdStopClientTcp() {
  *  Works only on SSL Clinet connection. 
  */
 void WiFiSpiEspCommandProcessor::cmdVerifySSLClient() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (3 input parameters)
-    if (data[3] != 3) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock;
-    char hostName[81];
-    uint8_t fingerprint[20];  // SHA1 value
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, fingerprint, sizeof(fingerprint)) != sizeof(fingerprint))
-        return;  // Failure - received invalid parameter
-    if (getParameterString(data, dataPos, hostName, sizeof(hostName)-1) <= 0)  // domain name
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &sock, sizeof(sock)) < 0)
-        return;  // Failure - received invalid parameter
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    if (params.len[1] == 0)
+        return;  // Failure - received invalid parameter (domain name)
 
     // Return error condition:
     // BearSSL does not provide method for ex-post testing of the SSL fingerprint
@@ -32,13 +32,7 @@ extern const char* PROTOCOL_VERSION;
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetFwVersion() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     replyStart(cmd, 1);
     replyParam((uint8_t*)VERSION, 5);
@@ -49,14 +43,8 @@ void WiFiSpiEspCommandProcessor::cmdGetFwVersion() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetMacAddr() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-  
+    uint8_t cmd = params.cmd;
+
     uint8_t macAddr[WL_MAC_ADDR_LENGTH];
     WiFi.macAddress(macAddr);
 
@@ -69,33 +57,14 @@ void WiFiSpiEspCommandProcessor::cmdGetMacAddr() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdSetIpConfig() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (5 input parameters)
-    if (data[3] != 5) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    uint32_t local_ip, gateway, subnet, dns_server1, dns_server2;
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&local_ip), sizeof(local_ip)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&gateway), sizeof(gateway)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&subnet), sizeof(subnet)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&dns_server1), sizeof(dns_server1)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&dns_server2), sizeof(dns_server2)) < 0)
-        return;  // Failure - received invalid parameter
-
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
+    uint8_t cmd = params.cmd;
+
+    uint32_t local_ip = paramU32(0);
+    uint32_t gateway = paramU32(1);
+    uint32_t subnet = paramU32(2);
+    uint32_t dns_server1 = paramU32(3);
+    uint32_t dns_server2 = paramU32(4);
+
     Serial.printf("Wifi.config, local_ip=%x, gateway=%x, subnet=%x, dns_server1=%x, dns_server2=%x\n", local_ip, gateway, subnet, dns_server1, dns_server2);
 
     uint8_t status = WiFi.config(local_ip, gateway, subnet, dns_server1, dns_server2);
@@ -109,14 +78,8 @@ void WiFiSpiEspCommandProcessor::cmdSetIpConfig() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdStartScanNetworks() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-  
+    uint8_t cmd = params.cmd;
+
     int8_t resp = WiFi.scanNetworks(true, true);
 
     replyStart(cmd, 1);
@@ -128,14 +91,8 @@ void WiFiSpiEspCommandProcessor::cmdStartScanNetworks() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdScanNetworks() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-      
+    uint8_t cmd = params.cmd;
+
     int8_t resp = WiFi.scanComplete();
 
     replyStart(cmd, 1);
@@ -147,15 +104,9 @@ void WiFiSpiEspCommandProcessor::cmdScanNetworks() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetScannedData() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t index = data[5];
+    uint8_t index = paramU8(0);
 
     String ssid = WiFi.SSID(index);
     int32_t rssi = WiFi.RSSI(index);
@@ -172,13 +123,7 @@ void WiFiSpiEspCommandProcessor::cmdGetScannedData() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdSoftwareReset() {
-    uint8_t cmd = data[2];
-
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     replyStart(cmd, 0);
     replyEnd();
@@ -192,16 +137,70 @@ void WiFiSpiEspCommandProcessor::cmdSoftwareReset() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetProtocolVersion() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     replyStart(cmd, 1);
     replyParam((uint8_t*)PROTOCOL_VERSION, 5);
     replyEnd();
 }
 
+/*
+    Switches between confirmed (PROTOCOL_MODE_CONFIRM) and credit based (PROTOCOL_MODE_CREDIT) transfers.
+    The reply is sent in the new mode, returns 1 when the mode was set
+ */
+void WiFiSpiEspCommandProcessor::cmdSetProtocolMode() {
+    uint8_t cmd = params.cmd;
+
+    uint8_t mode = paramU8(0);
+    uint8_t status = 0;
+
+    if (mode == PROTOCOL_MODE_CONFIRM || mode == PROTOCOL_MODE_CREDIT) {
+        setProtocolMode(mode);
+        status = 1;
+    }
+
+    replyStart(cmd, 1);
+    replyParam(&status, 1);
+    replyEnd();
+}
+
+/*
+    Switches the frame check between crc8 (FRAME_CHECK_CRC8) and crc16 (FRAME_CHECK_CRC16) for long wires.
+    The reply is sent with the new check, returns 1 when the check was set
+ */
+void WiFiSpiEspCommandProcessor::cmdSetFrameCheck() {
+    uint8_t cmd = params.cmd;
+
+    uint8_t mode = paramU8(0);
+    uint8_t status = 0;
+
+    if (mode == FRAME_CHECK_CRC8 || mode == FRAME_CHECK_CRC16) {
+        setFrameCheckMode(mode);
+        status = 1;
+    }
+
+    replyStart(cmd, 1);
+    replyParam(&status, 1);
+    replyEnd();
+}
+
+/*
+    Sets the length of the status register to 2 or 4 bytes (with the reply length hint).
+    The master reads the status of the reply with the new length, returns 1 when the length was set
+ */
+void WiFiSpiEspCommandProcessor::cmdSetStatusLength() {
+    uint8_t cmd = params.cmd;
+
+    uint8_t len = paramU8(0);
+    uint8_t status = 0;
+
+    if (len == 2 || len == 4) {
+        setStatusLength(len);
+        status = 1;
+    }
+
+    replyStart(cmd, 1);
+    replyParam(&status, 1);
+    replyEnd();
+}
+
@@ -26,33 +26,11 @@
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdStartServer() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (3 input parameters)
-    if (data[3] != 3) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    uint16_t port;
-    uint8_t sock;
-    uint8_t protocol;  // TCP / UDP
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&port), sizeof(port)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &sock, sizeof(sock)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &protocol, sizeof(protocol)) < 0)
-        return;  // Failure - received invalid parameter
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
+
+    uint16_t port = paramU16(0);
+    uint8_t sock = paramU8(1);
+    uint8_t protocol = paramU8(2);  // TCP / UDP
 
     #ifdef _DEBUG
         Serial.printf("WifiServer.startServer, sock=%d, port=%d, protocol=%d\n", sock, port, protocol);
@@ -65,13 +43,12 @@ void WiFiSpiEspCommandProcessor::cmdStartServer() {
     uint8_t status;
     
     if (protocol == TCP_MODE) {
-        servers[sock] = new WiFiServer(port);
-        servers[sock]->begin();
-        status = servers[sock]->status();
+        WiFiServer *server = newServer(sock, port);
+        server->begin();
+        status = server->status();
         status = (status == LISTEN || status == ESTABLISHED);
     } else {
-        serversUDP[sock] = new WiFiUDP();
-        status = serversUDP[sock]->begin(port);
+        status = newUdp(sock)->begin(port);
     }
 
     replyStart(cmd, 1);
@@ -83,24 +60,11 @@ void WiFiSpiEspCommandProcessor::cmdStartServer() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetStateTcp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
-    uint8_t status;
-    
-    if (servers[sock] == nullptr)
-        status = CLOSED;
-    else
-        status = servers[sock]->status();
+    uint8_t status = serverState(sock);
 
     replyStart(cmd, 1);
     replyParam(&status, 1);
@@ -111,17 +75,9 @@ void WiFiSpiEspCommandProcessor::cmdGetStateTcp() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdStopServer() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
     stopServer(sock);
 
@@ -133,28 +89,14 @@ void WiFiSpiEspCommandProcessor::cmdStopServer() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetRemoteDataCmd() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
-    uint32_t ipAddr = 0;
-    uint16_t port = 0;
+    uint32_t ipAddr;
+    uint16_t port;
     
-    if (serversUDP[sock] != nullptr) {
-        ipAddr = serversUDP[sock]->remoteIP();  // UDP connection
-        port = serversUDP[sock]->remotePort();
-    } else if (clients[sock] != nullptr) {
-        ipAddr = clients[sock]->remoteIP();  // TCP connection (server or client)
-        port = clients[sock]->remotePort();
-    }
+    socketRemote(sock, ipAddr, port);
 
     #ifdef _DEBUG
         Serial.printf("%d: IP=%x, port=%d\n", sock, ipAddr, port);
@@ -166,3 +108,34 @@ void WiFiSpiEspCommandProcessor::cmdGetRemoteDataCmd() {
     replyEnd();
 }
 
+/*
+    Returns the state of all the sockets, one parameter of 11 bytes per socket:
+    type (tSocketType), client state (1 = connected), server state (as GET_STATE_TCP_CMD), 
+    bytes available (int16), remote IP (4 bytes) and remote port (uint16).
+    Unlike GET_CLIENT_STATE_TCP_CMD it does not take over a new client waiting on the server.
+ */
+void WiFiSpiEspCommandProcessor::cmdGetSocketsState() {
+    uint8_t cmd = params.cmd;
+
+    replyStart(cmd, MAX_SOCKETS);
+
+    for (uint8_t sock = 0;  sock < MAX_SOCKETS;  ++sock) {
+        uint8_t state[11];
+        int16_t avail = socketAvailable(sock);
+        uint32_t ipAddr;
+        uint16_t port;
+
+        socketRemote(sock, ipAddr, port);
+
+        state[0] = sockets[sock].type;
+        state[1] = socketConnected(sock);
+        state[2] = serverState(sock);
+        memcpy(state + 3, &avail, sizeof(avail));
+        memcpy(state + 5, &ipAddr, sizeof(ipAddr));
+        memcpy(state + 9, &port, sizeof(port));
+
+        replyParam(state, sizeof(state));
+    }
+
+    replyEnd();
+}
@@ -20,6 +20,7 @@
 
 #include "WiFiSPICmd.h"
 #include "SPICalls.h"
+#include "BufferPool.h"
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
 
@@ -27,36 +28,13 @@
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdBeginUdpPacket() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (3 input parameters)
-    if (data[3] != 3) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
-    int32_t ipAddr;
-    uint16_t port;
-    uint8_t sock;
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&ipAddr), sizeof(ipAddr)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&port), sizeof(port)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &sock, sizeof(sock)) < 0)
-        return;  // Failure - received invalid parameter
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    setTxStatus(SPISLAVE_TX_PREPARING_DATA);
+    int32_t ipAddr = paramU32(0);
+    uint16_t port = paramU16(1);
+    uint8_t sock = paramU8(2);
+
+    replyPrepare();
     
     #ifdef _DEBUG
         Serial.printf("WifiUdp.beginUdpPacket, sock=%d, ip=%s, port=%d\n", sock, IPAddress(ipAddr).toString().c_str(), port);
@@ -64,14 +42,15 @@ void WiFiSpiEspCommandProcessor::cmdBeginUdpPacket() {
     
     uint8_t status;
     
-    if (serversUDP[sock] != nullptr) {
+    if (sockets[sock].type == SOCKET_UDP) {
         uint8_t firstByte = ipAddr & 0xff;
+        sockets[sock].udpTxLen = 0;
 
         // Check unicast / multicast
         if (firstByte < 224 || firstByte > 239)
-            status = serversUDP[sock]->beginPacket(IPAddress(ipAddr), port);
+            status = sockets[sock].udp->beginPacket(IPAddress(ipAddr), port);
         else
-            status = serversUDP[sock]->beginPacketMulticast(IPAddress(ipAddr), port, WiFi.localIP());
+            status = sockets[sock].udp->beginPacketMulticast(IPAddress(ipAddr), port, WiFi.localIP());
     }
     else
         status = 0;
@@ -85,64 +64,40 @@ void WiFiSpiEspCommandProcessor::cmdBeginUdpPacket() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdInsertDatabuf() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 2 || data[4] != 1) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
+    uint16_t len = params.dataLen;
 
-    uint16_t len = data[6] | (data[7] << 8);
-
-    // Limit the length to 4000 characters
-    // TODO: Remove the limit
-    if (len > 4000) {
+    // Get a buffer for one chunk of the data, without it the payload is dropped and the reply reports
+    // no data appended to the packet
+    payload.buffer = poolAlloc(PAYLOAD_CHUNK_SIZE);
+    if (payload.buffer == nullptr) {
         #ifdef _DEBUG
-            Serial.println(F("Too much data (>4000 bytes)."));
+            Serial.printf("No buffer (%d).\n", PAYLOAD_CHUNK_SIZE);
         #endif
+        startPayload(params.dataPos, sock, len, skipReceive, completeInsertDatabuf);
         return;  // Failure
     }
 
-    uint8_t dataPos = 8;  // Position in the input buffer
+    // The data is appended to the packet by chunks as the frames come in, the reply is sent by completeInsertDatabuf
+    startPayload(params.dataPos, sock, len, receiveIntoClient, completeInsertDatabuf);
+}
 
-    // Allocate a buffer
-    uint8_t* buffer = static_cast<uint8_t*>(malloc(len));
-    if (buffer == nullptr) {
-        #ifdef _DEBUG
-            Serial.printf("Malloc (%d) failed.\n", len);
-        #endif
+/*
+    Called when the payload of INSERT_DATABUF_CMD is received
+ */
+void WiFiSpiEspCommandProcessor::completeInsertDatabuf(bool ok) {
+    if (!ok) {
+        poolFree(payload.buffer);
         return;  // Failure
     }
 
-    // Read input data into the buffer
-    uint8_t* buf = buffer;
-    for (uint16_t i = 0;  i < len;  ++i)
-    {
-        // Get next character
-        int16_t b = readByte(data, dataPos);
-        if (b < 0) {
-            #ifdef _DEBUG
-                Serial.println(F("Not enough data."));
-            #endif
-            return;  // Failure
-        }
-    
-        *buf++ = b;
-    }
-
-    if (serversUDP[sock] != nullptr)
-        len = serversUDP[sock]->write(static_cast<const uint8_t*>(buffer), len);
-    else
-        len = 0;
+    // Append the rest of the data
+    flushIntoClient();
+    poolFree(payload.buffer);
 
-    free(buffer);
+    uint16_t len = payload.written;
 
-    replyStart(cmd, 1);
+    replyStart(payload.cmd, 1);
     replyParam(reinterpret_cast<const uint8_t *>(&len), sizeof(len));
     replyEnd();    
 }
@@ -151,22 +106,14 @@ void WiFiSpiEspCommandProcessor::cmdInsertDatabuf() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdSendDataUdp() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
     uint8_t status;
     
-    if (serversUDP[sock] != nullptr)
-        status = serversUDP[sock]->endPacket();
+    if (sockets[sock].type == SOCKET_UDP)
+        status = sockets[sock].udp->endPacket();
     else
         status = 0;
 
@@ -179,24 +126,29 @@ void WiFiSpiEspCommandProcessor::cmdSendDataUdp() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdUdpParsePacket() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the input parameter
-    if (data[3] != 1 || data[4] != 1 || data[6] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
-    uint8_t sock = data[5];
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
+    uint8_t sock = paramU8(0);
 
     int16_t avail;
     
-    if (serversUDP[sock] != nullptr)
-        avail = serversUDP[sock]->parsePacket();
-    else
+    tSocket &s = sockets[sock];
+
+    if (s.type != SOCKET_UDP)
         avail = 0;
+    else {
+        if (s.udpParsed) {
+            // The packet was already parsed for the status register
+            s.udpParsed = false;
+            avail = s.udp->available();
+        }
+        else
+            avail = s.udp->parsePacket();
+
+        // The sender stays until the next packet is taken over
+        s.udpRemoteIP = s.udp->remoteIP();
+        s.udpRemotePort = s.udp->remotePort();
+    }
 
     #ifdef _DEBUG
         Serial.printf("ParsePacket[%d] = %d\n", sock, avail);
@@ -211,33 +163,11 @@ void WiFiSpiEspCommandProcessor::cmdUdpParsePacket() {
  *
  */
 void WiFiSpiEspCommandProcessor::cmdStartServerMulticast() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (3 input parameters)
-    if (data[3] != 3) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    uint32_t ipAddr;
-    uint16_t port;
-    uint8_t sock;
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&ipAddr), sizeof(ipAddr)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, reinterpret_cast<uint8_t*>(&port), sizeof(port)) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameter(data, dataPos, &sock, sizeof(sock)) < 0)
-        return;  // Failure - received invalid parameter
-    if (sock >= MAX_SOCK_NUM)
-        return;  // Invalid socket number
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
+
+    uint32_t ipAddr = paramU32(0);
+    uint16_t port = paramU16(1);
+    uint8_t sock = paramU8(2);
 
     #ifdef _DEBUG
         Serial.printf("WiFiUDP.startServerMulticast, ip=%d, sock=%d, port=%d\n", ipAddr, sock, port);
@@ -249,8 +179,7 @@ void WiFiSpiEspCommandProcessor::cmdStartServerMulticast() {
     // Open
     uint8_t status;
     
-    serversUDP[sock] = new WiFiUDP();
-    status = serversUDP[sock]->beginMulticast(WiFi.localIP(), IPAddress(ipAddr), port);
+    status = newUdp(sock)->beginMulticast(WiFi.localIP(), IPAddress(ipAddr), port);
 
     replyStart(cmd, 1);
     replyParam(&status, 1);
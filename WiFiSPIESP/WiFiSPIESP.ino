@@ -48,6 +48,7 @@
   0.2.4 25.01.21 JB  Added UDP Multicast transmit and receive
   0.2.5 14.02.21 JB  Added SET_SSL_FINGERPRINT_CMD command, protocol 0.2.5
   0.3.0 13.05.21 JB  Advanced the version and protocol to 0.3.0
+  0.4.0 16.10.26 JB  Credit based transfers, crc16 frame check, 4 byte status, waiting reads, protocol 0.4.0
  */
 
 // This define adds WifiManager to the project (optional) (see https://github.com/tzapu/WiFiManager)
@@ -56,6 +57,7 @@
 #include "SPISlave.h"
 #include "SPICalls.h"
 #include "WiFiSPICmd.h"
+#include "BufferPool.h"
 
 #include <ESP8266WiFi.h>
 
@@ -65,9 +67,9 @@
 #endif
 
 // Library version (format a.b.c)
-const char* VERSION = "0.3.0";
+const char* VERSION = "0.4.0";
 // Protocol version (format a.b.c) 
-const char* PROTOCOL_VERSION = "0.3.0";
+const char* PROTOCOL_VERSION = "0.4.0";
 
 const uint8_t SS_ENABLE_PIN = 5;  // PIN for circuit blocking SS to GPIO15 on reset 
 
@@ -166,8 +168,7 @@ void setup()
     SPISlave.begin();
 
     // Receiver and transmitter state
-    setRxStatus(SPISLAVE_RX_READY);
-    setTxStatus(SPISLAVE_TX_NODATA);
+    refreshStatus();
 
     // Initialize command processor
     WiFiSpiEspCommandProcessor::init();
@@ -178,14 +179,10 @@ void setup()
  * Loop
  */
 void loop() {
-    // Loop until received data packet
-    if (dataReceived) {
+    uint8_t dataBuf[32];  // copy of receiver buffer
 
-        uint8_t dataBuf[32];  // copy of receiver buffer
-        
-//        uint32_t savedPS = noInterrupts();  // cli();
-        memcpy(dataBuf, inputBuffer, 32);
-//        xt_wsr_ps(savedPS);  // sei();
+    // Loop until received data packet, a message is processed when it doesn't need to wait for its next frames
+    if (WiFiSpiEspCommandProcessor::messageReady() && readFrame(dataBuf)) {
 
 #ifdef _DEBUG    
 /*        Serial.print("gotData ");
@@ -195,20 +192,24 @@ void loop() {
 #endif        
      
         WiFiSpiEspCommandProcessor::processCommand(dataBuf);
-
-        // First enable the receiver and then enable the code in loop()
-        setRxStatus(SPISLAVE_RX_READY);
-        dataReceived = false;
     }
     else
         refreshStatus();  // Helps to stabilize the SPI bus after a reset, only ensures the status register value is ok
 
+    WiFiSpiEspCommandProcessor::poll();
+
 #if defined(ESPSPI_MONITOR)
     static uint32_t m = 0;
     if (millis() - m > 10000) {
         m = millis();
         long fh = ESP.getFreeHeap();
         Serial.printf("Heap: %ld\n", fh);
+
+    #if defined(ESPSPI_STATISTICS)
+        printSPIStatistics();
+        WiFiSpiEspCommandProcessor::printStatistics();
+        printPoolStatistics();
+    #endif
     }
 #endif
 }
@@ -26,13 +26,7 @@
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetConnStatus() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     uint8_t status = WiFi.status();
       
@@ -45,28 +39,11 @@ void WiFiSpiEspCommandProcessor::cmdGetConnStatus() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdSetPassphrase() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameters (2 input parameters)
-    if (data[3] != 2) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    char ssid[WL_SSID_MAX_LENGTH+1];
-    char passphrase[WL_WPA_KEY_MAX_LENGTH+1];
+    uint8_t cmd = params.cmd;
 
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameterString(data, dataPos, ssid, sizeof(ssid)-1) < 0)
-        return;  // Failure - received invalid parameter
-    if (getParameterString(data, dataPos, passphrase, sizeof(passphrase)-1) < 0)
-        return;  // Failure - received invalid parameter
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    // Too long values are cut like in the former fixed size buffers
+    const char *ssid = paramString(0, WL_SSID_MAX_LENGTH);
+    const char *passphrase = paramString(1, WL_WPA_KEY_MAX_LENGTH);
 
 #if defined(ESPSPI_MONITOR)
         Serial.printf("Conn: %s", ssid);
@@ -93,26 +70,9 @@ void WiFiSpiEspCommandProcessor::cmdSetPassphrase() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdSetNet() {
-    uint8_t cmd = data[2];
-    
-    // Get and test the parameter
-    if (data[3] != 1) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
-    char ssid[WL_SSID_MAX_LENGTH+1];
+    uint8_t cmd = params.cmd;
 
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    // Read parameters
-    if (getParameterString(data, dataPos, ssid, sizeof(ssid)-1) < 0)
-        return;  // Failure - received invalid parameter
-    
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    const char *ssid = paramString(0, WL_SSID_MAX_LENGTH);
 
     #ifdef _DEBUG
         Serial.printf("Wifi.begin, ssid=%s\n", ssid);
@@ -132,13 +92,7 @@ void WiFiSpiEspCommandProcessor::cmdSetNet() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdDisconnect() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     uint8_t status = disconnect();
 
@@ -151,14 +105,8 @@ void WiFiSpiEspCommandProcessor::cmdDisconnect() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetIpAddr() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
+    uint8_t cmd = params.cmd;
+
     union {
         uint8_t bytes[4];  // IPv4 address
         uint32_t dword;
@@ -179,14 +127,8 @@ void WiFiSpiEspCommandProcessor::cmdGetIpAddr() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetCurrSsid() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] !=0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-    
+    uint8_t cmd = params.cmd;
+
     replyStart(cmd, 1);
     replyParam(reinterpret_cast<const uint8_t*>(WiFi.SSID().c_str()), WiFi.SSID().length());
     replyEnd();
@@ -196,13 +138,7 @@ void WiFiSpiEspCommandProcessor::cmdGetCurrSsid() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetCurrRssi() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    uint8_t cmd = params.cmd;
 
     int32_t rssi = WiFi.RSSI();
     
@@ -215,14 +151,8 @@ void WiFiSpiEspCommandProcessor::cmdGetCurrRssi() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetCurrBssid() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 0 || data[4] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-  
+    uint8_t cmd = params.cmd;
+
     replyStart(cmd, 1);
     replyParam(WiFi.BSSID(), WL_MAC_ADDR_LENGTH);
     replyEnd();
@@ -232,29 +162,13 @@ void WiFiSpiEspCommandProcessor::cmdGetCurrBssid() {
  * 
  */
 void WiFiSpiEspCommandProcessor::cmdGetHostByName() {
-    uint8_t cmd = data[2];
-    
-    // Test the parameters
-    if (data[3] != 1) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-
-    char hostName[WL_HOSTNAME_MAX_LENGTH];
+    uint8_t cmd = params.cmd;
 
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    if (getParameterString(data, dataPos, hostName, sizeof(hostName)-1) < 0)
-        return;  // Failure - received invalid parameter
-        
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
+    const char *hostName = paramString(0);
 
     IPAddress ipAddress;
 
-    setTxStatus(SPISLAVE_TX_PREPARING_DATA);
+    replyPrepare();
 
     uint8_t status = WiFi.hostByName(hostName, ipAddress);
     
@@ -276,36 +190,16 @@ void WiFiSpiEspCommandProcessor::cmdGetHostByName() {
 
 void WiFiSpiEspCommandProcessor::cmdSetSSLFingerprint()
 {
-    uint8_t cmd = data[2];
+    uint8_t cmd = params.cmd;
 
-    // Get and test the parameters (0 or 1 input parameter)
+    // 0 or 1 input parameter
     // No input - disable the fingerprint validation
     // 1 input parameter - set fingerprint value and enable the validation
-    if (data[3] != 0 && data[3] != 1) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
-
-    uint8_t fingerprint[20];  // SHA1 value
-
-    uint8_t dataPos = 4;  // Position in the input buffer
-
-    if (data[3] == 1)
-    {
-		// Read parameter
-		if (getParameter(data, dataPos, fingerprint, sizeof(fingerprint)) != sizeof(fingerprint))
-			return;  // Failure - received invalid parameter
-    }
-
-    if (data[dataPos] != END_CMD) {
-        Serial.println(FPSTR(INVALID_MESSAGE_BODY));
-        return;  // Failure - received invalid message
-    }
 
-    if (data[3] == 1)
+    if (params.count == 1)
     {
 		// Set the global SSL fingerprint value
-		memcpy(SSLFingerprint, fingerprint, 20);
+		memcpy(SSLFingerprint, params.value[0], 20);
 		useSSLFingerprint = true;
     }
     else
@@ -313,7 +207,7 @@ void WiFiSpiEspCommandProcessor::cmdSetSSLFingerprint()
 
 #ifdef _DEBUG
     Serial.print("SetSSLFingerprint: ");
-    if (data[3] == 1)
+    if (params.count == 1)
     {
 		for (int i=0; i<20; ++i)
 			Serial.printf("%02x ", SSLFingerprint[i]);
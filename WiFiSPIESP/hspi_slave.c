@@ -91,12 +91,30 @@ void hspi_slave_begin(uint8_t status_len, void * arg)
     ETS_SPI_INTR_ENABLE();
 }
 
-void ICACHE_RAM_ATTR hspi_slave_setStatus(uint16_t status)
+void hspi_slave_setStatusLength(uint8_t status_len)
+{
+    status_len &= 7;
+    if(status_len > 4) {
+        status_len = 4;    //max 32 bits
+    }
+    if(status_len == 0) {
+        status_len = 1;    //min 8 bits
+    }
+
+    SPI1S1 = (SPI1S1 & ~(0x1f << SPIS1LSTA)) | (((status_len * 8) - 1) << SPIS1LSTA);
+}
+
+void ICACHE_RAM_ATTR hspi_slave_setStatus(uint32_t status)
 {
     SPI1WS = status;
 }
 
-void hspi_slave_setData(uint8_t *data, uint8_t len)
+uint32_t ICACHE_RAM_ATTR hspi_slave_getStatus()
+{
+    return SPI1WS;
+}
+
+void ICACHE_RAM_ATTR hspi_slave_setData(uint8_t *data, uint8_t len)
 {
     uint8_t i;
     uint32_t out = 0;
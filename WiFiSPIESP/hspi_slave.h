@@ -26,8 +26,14 @@
 //Start SPI SLave
 void hspi_slave_begin(uint8_t status_len, void * arg);
 
+//change the status length (1-4 bytes)
+void hspi_slave_setStatusLength(uint8_t status_len);
+
 //set the status register so the master can read it
-void hspi_slave_setStatus(uint16_t status);
+void hspi_slave_setStatus(uint32_t status);
+
+//get the status register (the value last read by the master)
+uint32_t hspi_slave_getStatus();
 
 //set the data registers (max 32 bytes at a time)
 void hspi_slave_setData(uint8_t *data, uint8_t len);
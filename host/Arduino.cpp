@@ -0,0 +1,192 @@
+/*
+    Arduino core stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "SimScheduler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+bool simSerialOutput = false;
+
+static uint8_t pins[32];
+
+/*
+ * Pins
+ */
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    pins[pin & 0x1f] = val;
+}
+
+int digitalRead(uint8_t pin) {
+    return pins[pin & 0x1f];
+}
+
+/*
+    Time, runs on the virtual clock. Reading the clock lets the master run like the SPI interrupt
+    would, so the busy waiting loops of the sketch get their data.
+ */
+uint32_t millis() {
+    simRunMaster();
+    return static_cast<uint32_t>(simTimeNs() / 1000000);
+}
+
+uint32_t micros() {
+    simRunMaster();
+    return static_cast<uint32_t>(simTimeNs() / 1000);
+}
+
+/*
+ * The master runs during the delay, the rest of the time elapses when it waits
+ */
+void delay(uint32_t ms) {
+    uint64_t end = simTimeNs() + static_cast<uint64_t>(ms) * 1000000;
+
+    while (simMasterRunning() && simTimeNs() < end)
+        simRunMaster();
+
+    uint64_t now = simTimeNs();
+    if (now < end)
+        simAdvance(end - now);
+}
+
+void yield() {
+    simRunMaster();
+}
+
+/*
+ * Serial
+ */
+void HardwareSerial::begin(unsigned long baud) {
+    (void)baud;
+}
+
+void HardwareSerial::setDebugOutput(bool enable) {
+    (void)enable;
+}
+
+void HardwareSerial::flush() {
+    if (simSerialOutput)
+        fflush(stderr);
+}
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    if (!simSerialOutput)
+        return 0;
+
+    va_list args;
+    va_start(args, format);
+    int len = vfprintf(stderr, format, args);
+    va_end(args);
+
+    return len > 0 ? len : 0;
+}
+
+size_t HardwareSerial::print(const char *str) {
+    return printf("%s", str);
+}
+
+size_t HardwareSerial::print(const __FlashStringHelper *str) {
+    return printf("%s", reinterpret_cast<const char *>(str));
+}
+
+size_t HardwareSerial::print(const String &str) {
+    return printf("%s", str.c_str());
+}
+
+size_t HardwareSerial::print(char c) {
+    return printf("%c", c);
+}
+
+size_t HardwareSerial::print(int n) {
+    return printf("%d", n);
+}
+
+size_t HardwareSerial::print(unsigned int n) {
+    return printf("%u", n);
+}
+
+size_t HardwareSerial::print(long n) {
+    return printf("%ld", n);
+}
+
+size_t HardwareSerial::print(unsigned long n) {
+    return printf("%lu", n);
+}
+
+size_t HardwareSerial::println() {
+    return printf("\n");
+}
+
+size_t HardwareSerial::println(const char *str) {
+    return print(str) + println();
+}
+
+size_t HardwareSerial::println(const __FlashStringHelper *str) {
+    return print(str) + println();
+}
+
+size_t HardwareSerial::println(const String &str) {
+    return print(str) + println();
+}
+
+size_t HardwareSerial::println(char c) {
+    return print(c) + println();
+}
+
+size_t HardwareSerial::println(int n) {
+    return print(n) + println();
+}
+
+size_t HardwareSerial::println(unsigned int n) {
+    return print(n) + println();
+}
+
+size_t HardwareSerial::println(long n) {
+    return print(n) + println();
+}
+
+size_t HardwareSerial::println(unsigned long n) {
+    return print(n) + println();
+}
+
+/*
+ * ESP
+ */
+void EspClass::restart() {
+    fprintf(stderr, "ESP.restart() called, the simulation ends\n");
+    exit(0);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return 40000;
+}
+
+uint32_t EspClass::getCycleCount() {
+    return static_cast<uint32_t>(simTimeNs() * 80 / 1000);  // 80 MHz
+}
@@ -0,0 +1,147 @@
+/*
+    Arduino core stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _HOST_ARDUINO_H_INCLUDED
+#define _HOST_ARDUINO_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+    #include <algorithm>
+    #include <string>
+#else
+    #include <stdbool.h>
+#endif
+
+/*
+    Only the parts of the ESP8266 Arduino core used by the sketch are provided.
+    The time functions run on the virtual clock of the simulation (SimScheduler.h),
+    yield() and delay() hand the CPU over to the simulated SPI master.
+*/
+
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t *>(addr))
+#define memcpy_P memcpy
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x00
+#define OUTPUT 0x01
+
+#define LED_BUILTIN 2
+
+// The SPI callbacks run between the bus transactions of the simulated master, never during the main code
+#define xt_rsil(level)    (0)
+#define xt_wsr_ps(state)  ((void)(state))
+#define interrupts()      ((void)0)
+#define noInterrupts()    xt_rsil(15)
+
+typedef bool boolean;
+
+#ifdef __cplusplus
+
+using std::min;
+using std::max;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void yield();
+
+/*
+ * Flash strings are ordinary strings on the host
+ */
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+
+/*
+ * Arduino String, only the members used by the sketch
+ */
+class String {
+public:
+    String(const char *cstr = "") : s(cstr) {}
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    String &operator+=(const char *cstr) { s += cstr; return *this; }
+    String &operator+=(char c) { s += c; return *this; }
+
+private:
+    std::string s;
+};
+
+/*
+ * Serial port, the output goes to stderr when enabled by simSerialOutput
+ */
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    void setDebugOutput(bool enable);
+    void flush();
+
+    size_t printf(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+
+    size_t print(const char *str);
+    size_t print(const __FlashStringHelper *str);
+    size_t print(const String &str);
+    size_t print(char c);
+    size_t print(int n);
+    size_t print(unsigned int n);
+    size_t print(long n);
+    size_t print(unsigned long n);
+
+    size_t println();
+    size_t println(const char *str);
+    size_t println(const __FlashStringHelper *str);
+    size_t println(const String &str);
+    size_t println(char c);
+    size_t println(int n);
+    size_t println(unsigned int n);
+    size_t println(long n);
+    size_t println(unsigned long n);
+};
+
+extern HardwareSerial Serial;
+extern bool simSerialOutput;
+
+/*
+ * ESP specific functions
+ */
+class EspClass {
+public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getCycleCount();
+};
+
+extern EspClass ESP;
+
+#endif  // __cplusplus
+
+#endif
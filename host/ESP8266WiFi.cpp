@@ -0,0 +1,262 @@
+/*
+    ESP8266WiFi stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ESP8266WiFi.h"
+#include "WiFiUdp.h"
+#include "SimNetwork.h"
+
+#include <stdio.h>
+
+ESP8266WiFiClass WiFi;
+
+SimNetConfig simNetConfig = { 2920, 1460, 512 };
+SimNetStatistics simNetStats;
+
+/*
+ * IPAddress
+ */
+String IPAddress::toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", address & 0xff, (address >> 8) & 0xff, (address >> 16) & 0xff, address >> 24);
+    return String(buf);
+}
+
+/*
+ * WiFiClient
+ */
+WiFiClient::WiFiClient()
+    : isConnected(false), port(0), rxOffset(0), txOffset(0) {
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    remote = ip;
+    this->port = port;
+    rxOffset = 0;
+    txOffset = 0;
+    isConnected = true;
+    return 1;
+}
+
+uint8_t WiFiClient::connected() {
+    return isConnected;
+}
+
+void WiFiClient::stop() {
+    isConnected = false;
+}
+
+int WiFiClient::available() {
+    return isConnected ? simNetConfig.tcpRxChunk : 0;
+}
+
+int WiFiClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size) {
+    size_t len = std::min(size, static_cast<size_t>(available()));
+
+    for (size_t i = 0; i < len; ++i)
+        buf[i] = simPattern(rxOffset++);
+
+    simNetStats.tcpRxBytes += len;
+    return len;
+}
+
+int WiFiClient::peek() {
+    return isConnected ? simPattern(rxOffset) : -1;
+}
+
+size_t WiFiClient::availableForWrite() {
+    return isConnected ? simNetConfig.tcpWindow : 0;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size) {
+    size_t len = std::min(size, availableForWrite());
+
+    for (size_t i = 0; i < len; ++i)
+        if (buf[i] != simPattern(txOffset++))
+            ++simNetStats.dataErrors;
+
+    simNetStats.tcpTxBytes += len;
+    return len;
+}
+
+/*
+ * WiFiServer
+ */
+WiFiClient WiFiServer::available(uint8_t *status) {
+    (void)status;
+    return WiFiClient();
+}
+
+/*
+ * WiFi
+ */
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase) {
+    (void)ssid;
+    (void)passphrase;
+    currentStatus = WL_CONNECTED;
+    return currentStatus;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff) {
+    (void)wifioff;
+    currentStatus = WL_DISCONNECTED;
+    return true;
+}
+
+bool ESP8266WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+    (void)local_ip;
+    (void)gateway;
+    (void)subnet;
+    (void)dns1;
+    (void)dns2;
+    return true;
+}
+
+uint8_t *ESP8266WiFiClass::macAddress(uint8_t *mac) {
+    static const uint8_t address[6] = { 0x5c, 0xcf, 0x7f, 0x00, 0x00, 0x01 };
+    memcpy(mac, address, sizeof(address));
+    return mac;
+}
+
+uint8_t *ESP8266WiFiClass::BSSID() {
+    static uint8_t bssid[6] = { 0x5c, 0xcf, 0x7f, 0x00, 0x00, 0x02 };
+    return bssid;
+}
+
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool show_hidden) {
+    (void)async;
+    (void)show_hidden;
+    return 1;
+}
+
+int ESP8266WiFiClass::hostByName(const char *hostName, IPAddress &result) {
+    (void)hostName;
+    result = IPAddress(192, 168, 1, 100);
+    return 1;
+}
+
+/*
+ * WiFiUDP
+ */
+WiFiUDP::WiFiUDP()
+    : listening(false), sending(false), packets(0), rxPos(0), rxLen(0), txLen(0) {
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+    (void)port;
+    listening = true;
+    return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port) {
+    (void)interfaceAddr;
+    (void)multicast;
+    return begin(port);
+}
+
+void WiFiUDP::stop() {
+    listening = false;
+    sending = false;
+    rxPos = rxLen;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+    (void)ip;
+    (void)port;
+    sending = true;
+    txLen = 0;
+    return 1;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl) {
+    (void)interfaceAddress;
+    (void)ttl;
+    return beginPacket(multicastAddress, port);
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size) {
+    if (!sending)
+        return 0;
+
+    for (size_t i = 0; i < size; ++i)
+        if (buffer[i] != simPattern(txLen++))
+            ++simNetStats.dataErrors;
+
+    return size;
+}
+
+int WiFiUDP::endPacket() {
+    if (!sending)
+        return 0;
+
+    sending = false;
+    ++simNetStats.udpTxPackets;
+    simNetStats.udpTxBytes += txLen;
+    return 1;
+}
+
+/*
+ * Moves to the next datagram, the rest of the current one is dropped
+ */
+int WiFiUDP::parsePacket() {
+    if (!listening)
+        return 0;
+
+    if (rxLen > 0)
+        ++packets;
+    rxLen = simNetConfig.udpPacketSize;
+    rxPos = 0;
+    ++simNetStats.udpRxPackets;
+    return rxLen;
+}
+
+int WiFiUDP::available() {
+    return rxLen - rxPos;
+}
+
+int WiFiUDP::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t len) {
+    size_t n = std::min(len, static_cast<size_t>(available()));
+
+    for (size_t i = 0; i < n; ++i, ++rxPos)
+        buffer[i] = simPattern(packets + rxPos);
+
+    return n;
+}
+
+int WiFiUDP::peek() {
+    return available() > 0 ? simPattern(packets + rxPos) : -1;
+}
+
+IPAddress WiFiUDP::remoteIP() {
+    return rxLen > 0 ? IPAddress(simUdpRemoteIP(packets)) : IPAddress();
+}
+
+uint16_t WiFiUDP::remotePort() {
+    return rxLen > 0 ? simUdpRemotePort(packets) : 0;
+}
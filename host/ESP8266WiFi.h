@@ -0,0 +1,170 @@
+/*
+    ESP8266WiFi stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _HOST_ESP8266WIFI_H_INCLUDED
+#define _HOST_ESP8266WIFI_H_INCLUDED
+
+#include "Arduino.h"
+
+/*
+    The station is always connected, the sockets talk to the peers in SimNetwork.h.
+*/
+
+// Number of sockets (wl_definitions.h)
+#define MAX_SOCK_NUM 4
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+enum tcp_state {
+    CLOSED = 0,
+    LISTEN = 1,
+    SYN_SENT = 2,
+    SYN_RCVD = 3,
+    ESTABLISHED = 4,
+    FIN_WAIT_1 = 5,
+    FIN_WAIT_2 = 6,
+    CLOSE_WAIT = 7,
+    CLOSING = 8,
+    LAST_ACK = 9,
+    TIME_WAIT = 10
+};
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+/*
+ * IPv4 address
+ */
+class IPAddress {
+public:
+    IPAddress() : address(0) {}
+    IPAddress(uint32_t address) : address(address) {}
+    IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+        : address(b0 | (b1 << 8) | (b2 << 16) | (static_cast<uint32_t>(b3) << 24)) {}
+
+    operator uint32_t() const { return address; }
+
+    String toString() const;
+
+private:
+    uint32_t address;
+};
+
+/*
+ * TCP client
+ */
+class WiFiClient {
+public:
+    WiFiClient();
+    virtual ~WiFiClient() {}
+
+    int connect(IPAddress ip, uint16_t port);
+    uint8_t connected();
+    void stop();
+    void flush() {}
+
+    int available();
+    int read();
+    int read(uint8_t *buf, size_t size);
+    int peek();
+
+    size_t availableForWrite();
+    size_t write(const uint8_t *buf, size_t size);
+
+    IPAddress remoteIP() { return remote; }
+    uint16_t remotePort() { return port; }
+
+    static void stopAll() {}
+
+protected:
+    bool isConnected;
+    IPAddress remote;
+    uint16_t port;
+    uint32_t rxOffset;  // position in the stream of the peer
+    uint32_t txOffset;  // position in the stream sent to the peer
+};
+
+/*
+ * TCP server, no client ever connects
+ */
+class WiFiServer {
+public:
+    WiFiServer(uint16_t port) : port(port), state(CLOSED) {}
+
+    void begin() { state = LISTEN; }
+    void stop() { state = CLOSED; }
+    uint8_t status() { return state; }
+    bool hasClient() { return false; }
+    WiFiClient available(uint8_t *status = nullptr);
+
+private:
+    uint16_t port;
+    uint8_t state;
+};
+
+/*
+ * WiFi station
+ */
+class ESP8266WiFiClass {
+public:
+    void mode(WiFiMode_t m) { (void)m; }
+    void persistent(bool persistent) { (void)persistent; }
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr);
+    bool disconnect(bool wifioff = false);
+    bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = 0, IPAddress dns2 = 0);
+    wl_status_t status() { return currentStatus; }
+
+    IPAddress localIP() { return IPAddress(192, 168, 1, 2); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    uint8_t *macAddress(uint8_t *mac);
+    uint8_t *BSSID();
+    String SSID() { return String("simulated"); }
+    int32_t RSSI() { return -50; }
+
+    int8_t scanNetworks(bool async = false, bool show_hidden = false);
+    int8_t scanComplete() { return 1; }
+    String SSID(uint8_t i) { (void)i; return String("simulated"); }
+    int32_t RSSI(uint8_t i) { (void)i; return -50; }
+    uint8_t encryptionType(uint8_t i) { (void)i; return 4; }  // ENC_TYPE_CCMP
+
+    int hostByName(const char *hostName, IPAddress &result);
+
+private:
+    wl_status_t currentStatus = WL_CONNECTED;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
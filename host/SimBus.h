@@ -0,0 +1,65 @@
+/*
+    Master side of the simulated HSPI bus
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SIMBUS_H_INCLUDED
+#define _SIMBUS_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+    The transactions of the ESP8266 HSPI slave protocol. Every transaction moves
+    the virtual clock by the time of its command byte and data on the bus plus
+    the gap between two transactions (chip select, the master's own overhead)
+    and calls the slave's callback like the HSPI interrupt does.
+*/
+
+struct SimBusConfig {
+    uint32_t clockHz;       // SPI clock
+    uint32_t gapNs;         // time between two transactions
+    uint32_t corruptEvery;  // one in n data transactions at random gets a flipped bit, 0 = never
+};
+
+struct SimBusStatistics {
+    uint32_t statusReads;
+    uint32_t statusWrites;
+    uint32_t dataReads;
+    uint32_t dataWrites;
+    uint32_t corrupted;
+};
+
+extern SimBusConfig simBusConfig;
+extern SimBusStatistics simBusStats;
+
+// Command 0x04, reads the status register (the length set by the slave)
+uint32_t simBusReadStatus();
+
+// Command 0x01, writes the status register
+void simBusWriteStatus(uint32_t status);
+
+// Command 0x02, writes a 32 byte frame into the slave
+void simBusWriteData(const uint8_t *frame);
+
+// Command 0x03, reads the 32 byte frame prepared by the slave
+void simBusReadData(uint8_t *frame);
+
+// Status length set by the slave
+uint8_t simBusStatusLength();
+
+#endif
@@ -0,0 +1,354 @@
+/*
+    Simulated SPI master of the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SimMaster.h"
+#include "SimBus.h"
+#include "SimScheduler.h"
+#include "SPICalls.h"
+#include "WiFiSPICmd.h"
+
+#include <string.h>
+
+/*
+ * SimMessage
+ */
+SimMessage::SimMessage(uint8_t cmd, uint8_t numParams)
+    : msg({ START_CMD, cmd, numParams }), ended(false) {
+}
+
+SimMessage &SimMessage::param(const void *value, uint8_t len) {
+    msg.push_back(len);
+    msg.insert(msg.end(), static_cast<const uint8_t *>(value), static_cast<const uint8_t *>(value) + len);
+    return *this;
+}
+
+SimMessage &SimMessage::paramU8(uint8_t value) {
+    return param(&value, 1);
+}
+
+SimMessage &SimMessage::paramU16(uint16_t value) {
+    uint8_t le[2] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+    return param(le, sizeof(le));
+}
+
+SimMessage &SimMessage::paramU32(uint32_t value) {
+    uint8_t le[4] = { static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8),
+                      static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 24) };
+    return param(le, sizeof(le));
+}
+
+SimMessage &SimMessage::paramString(const char *value) {
+    return param(value, strlen(value));
+}
+
+SimMessage &SimMessage::paramData(const uint8_t *payload, uint16_t len) {
+    msg.push_back(len & 0xff);
+    msg.push_back(len >> 8);
+    msg.insert(msg.end(), payload, payload + len);
+    return *this;
+}
+
+const std::vector<uint8_t> &SimMessage::bytes() {
+    if (!ended) {
+        msg.push_back(END_CMD);
+        ended = true;
+    }
+    return msg;
+}
+
+/*
+ * SimReply
+ */
+bool SimReply::decode(const std::vector<uint8_t> &msg, bool data16) {
+    params.clear();
+
+    if (msg.size() < 4 || msg[0] != START_CMD || !(msg[1] & REPLY_FLAG))
+        return false;
+
+    cmd = msg[1] & 0x7f;
+    size_t pos = 3;
+
+    for (uint8_t i = 0;  i < msg[2];  ++i) {
+        size_t len;
+        if (data16) {
+            if (pos + 2 > msg.size())
+                return false;
+            len = (msg[pos] << 8) | msg[pos + 1];
+            pos += 2;
+        }
+        else {
+            if (pos + 1 > msg.size())
+                return false;
+            len = msg[pos++];
+        }
+
+        if (pos + len > msg.size())
+            return false;
+        params.push_back(std::vector<uint8_t>(msg.begin() + pos, msg.begin() + pos + len));
+        pos += len;
+    }
+
+    return pos < msg.size() && msg[pos] == END_CMD;
+}
+
+uint8_t SimReply::u8(uint8_t i) const {
+    return i < params.size() && params[i].size() >= 1 ? params[i][0] : 0;
+}
+
+uint16_t SimReply::u16(uint8_t i) const {
+    return i < params.size() && params[i].size() >= 2 ? params[i][0] | (params[i][1] << 8) : 0;
+}
+
+uint32_t SimReply::u32(uint8_t i) const {
+    if (i >= params.size() || params[i].size() < 4)
+        return 0;
+
+    const std::vector<uint8_t> &p = params[i];
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/*
+ * SimMaster
+ */
+SimMaster::SimMaster()
+    : stats(), frameCheck(FRAME_CHECK_CRC8), nextSeq(0), transferNs(0) {
+}
+
+uint8_t SimMaster::checkPos() const {
+    return frameCheck == FRAME_CHECK_CRC16 ? 30 : 31;
+}
+
+/*
+    Plain bitwise crcs, crc8 (polynom 0x07) in byte 31 or crc16 (polynom 0x1021, big endian)
+    in bytes 30-31, both start with zero
+ */
+static uint16_t crc(const uint8_t *buf, uint8_t len, bool crc16) {
+    uint16_t value = 0;
+
+    for (uint8_t i = 0;  i < len;  ++i) {
+        if (crc16) {
+            value ^= buf[i] << 8;
+            for (uint8_t b = 0;  b < 8;  ++b)
+                value = (value & 0x8000) ? (value << 1) ^ 0x1021 : value << 1;
+        }
+        else {
+            value ^= buf[i];
+            for (uint8_t b = 0;  b < 8;  ++b)
+                value = (value & 0x80) ? ((value << 1) ^ 0x07) & 0xff : (value << 1) & 0xff;
+        }
+    }
+
+    return value;
+}
+
+void SimMaster::putCheck(uint8_t *frame) const {
+    uint16_t value = crc(frame, checkPos(), frameCheck == FRAME_CHECK_CRC16);
+
+    if (frameCheck == FRAME_CHECK_CRC16) {
+        frame[30] = value >> 8;
+        frame[31] = value & 0xff;
+    }
+    else
+        frame[31] = value;
+}
+
+bool SimMaster::checkOk(const uint8_t *frame) const {
+    uint16_t value = crc(frame, checkPos(), frameCheck == FRAME_CHECK_CRC16);
+
+    if (frameCheck == FRAME_CHECK_CRC16)
+        return value == ((frame[30] << 8) | frame[31]);
+    else
+        return value == frame[31];
+}
+
+bool SimMaster::transfer(SimMessage &msg, SimReply &reply, uint32_t timeoutMs) {
+    std::vector<uint8_t> bytes;
+
+    if (!transfer(msg.bytes(), bytes, timeoutMs))
+        return false;
+
+    uint8_t cmd = msg.bytes()[1];
+    return reply.decode(bytes, cmd == GET_DATABUF_TCP_CMD || cmd == GET_DATABUF_WAIT_TCP_CMD) && reply.cmd == cmd;
+}
+
+/*
+    Writes the frames of the message and reads the reply frames. Every status read tells:
+    - the receiver state: the frames not accepted (SPISLAVE_RX_ERROR) are written again,
+      in PROTOCOL_MODE_CREDIT from the first frame not accepted; SPISLAVE_RX_READY acknowledges
+      the frames written before
+    - how many frames may be written: one when SPISLAVE_RX_READY, the credits in PROTOCOL_MODE_CREDIT
+    - how many reply frames may be read: one when SPISLAVE_TX_READY (confirmed by the next status
+      read), the queued frames in PROTOCOL_MODE_CREDIT (byte 2 of the 4 byte status when available)
+    A reply frame with a bad check is requested again by SPISLAVE_REQ_RESEND.
+ */
+bool SimMaster::transfer(const std::vector<uint8_t> &msg, std::vector<uint8_t> &reply, uint32_t timeoutMs) {
+    struct tFrame { uint8_t b[32]; };
+    std::vector<tFrame> frames;
+
+    uint8_t space = checkPos() - 1;
+    for (size_t pos = 0;  pos < msg.size();  pos += space) {
+        tFrame f = {};
+        size_t n = std::min(static_cast<size_t>(space), msg.size() - pos);
+
+        f.b[0] = (pos + n < msg.size()) ? MESSAGE_CONTINUES : MESSAGE_FINISHED;
+        memcpy(f.b + 1, msg.data() + pos, n);
+        putCheck(f.b);
+        frames.push_back(f);
+    }
+
+    // The reply of SET_FRAME_CHECK_CMD comes with the new check
+    int newCheck = -1;
+    if (msg.size() >= 5 && msg[1] == SET_FRAME_CHECK_CMD && msg[2] == 1 && msg[3] == 1 && msg[4] <= FRAME_CHECK_CRC16)
+        newCheck = msg[4];
+
+    ++stats.commands;
+    reply.clear();
+
+    uint64_t start = simTimeNs();
+    uint64_t deadline = start + static_cast<uint64_t>(timeoutMs) * 1000000;
+    size_t next = 0;  // next frame to write
+    size_t base = 0;  // first frame written after the last status read
+    bool firstReplyFrame = true;
+    bool done = false;
+
+    while (!done) {
+        if (simTimeNs() > deadline) {
+            ++stats.timeouts;
+            transferNs = simTimeNs() - start;
+            return false;
+        }
+
+        uint32_t status = simBusReadStatus();
+        uint8_t state = status & 0xff;
+        bool credit = state & SPISLAVE_STATUS_CREDIT;
+
+        if (credit ? (state & 0x4c) != 0 : (state & 0xcc) != 0 || ((status >> 8) & 0xff) != (state ^ 0xff)) {
+            ++stats.badStatus;
+            simRunSlave();
+            continue;
+        }
+
+        uint8_t rx = (state >> 4) & 0x03;
+        uint8_t tx = state & 0x03;
+        uint8_t rxFree = (status >> 12) & 0x0f;
+        uint8_t txQueued = simBusStatusLength() == 4 ? (status >> 16) & 0x7f : (status >> 8) & 0x0f;
+
+        if (rx == SPISLAVE_RX_ERROR && next > base) {
+            // Not acknowledged, the high nibble is the number of the frames accepted before
+            size_t accepted = credit ? rxFree : 0;
+            stats.framesRewritten += next - (base + accepted);
+            next = base + accepted;
+            base = next;
+            continue;
+        }
+
+        // A busy receiver may still reject the frames (their crc is checked in the main code)
+        if (rx == SPISLAVE_RX_READY)
+            base = next;
+
+        // Write the message
+        if (next < frames.size()) {
+            uint8_t n = credit ? rxFree : (rx == SPISLAVE_RX_READY ? 1 : 0);
+            if (n == 0)
+                simRunSlave();
+
+            for (;  n > 0 && next < frames.size();  --n, ++next) {
+                simBusWriteData(frames[next].b);
+                ++stats.framesWritten;
+            }
+            continue;
+        }
+
+        if (newCheck >= 0) {
+            frameCheck = newCheck;
+            newCheck = -1;
+        }
+
+        // Read the reply
+        uint8_t f[32];
+        uint8_t end = checkPos();
+
+        if (!credit) {
+            if (tx != SPISLAVE_TX_READY) {
+                simRunSlave();
+                continue;
+            }
+
+            simBusReadData(f);
+            ++stats.framesRead;
+
+            if (!checkOk(f)) {
+                ++stats.resendRequests;
+                simBusWriteStatus(SPISLAVE_REQ_RESEND);
+                continue;
+            }
+            if (f[0] != MESSAGE_FINISHED && f[0] != MESSAGE_CONTINUES)
+                return false;
+
+            reply.insert(reply.end(), f + 1, f + end);
+            if (f[0] == MESSAGE_FINISHED) {
+                simBusReadStatus();  // confirms the last frame
+                done = true;
+            }
+            continue;
+        }
+
+        if (txQueued == 0) {
+            simRunSlave();
+            continue;
+        }
+
+        while (txQueued > 0 && !done) {
+            simBusReadData(f);
+            ++stats.framesRead;
+
+            if (!checkOk(f)) {
+                // The frame is loaded again at once
+                ++stats.resendRequests;
+                simBusWriteStatus(SPISLAVE_REQ_RESEND | (nextSeq << 8));
+                if (simTimeNs() > deadline)
+                    break;
+                continue;
+            }
+            if ((f[0] & 0xe0) != MESSAGE_FINISHED_SEQ)
+                return false;
+
+            uint8_t seq = f[0] & 0x0f;
+            if (!firstReplyFrame && seq != nextSeq) {
+                if (seq != ((nextSeq - 1) & 0x0f))
+                    return false;
+
+                // Read again before the next frame was loaded
+                ++stats.repeatedFrames;
+                break;
+            }
+
+            firstReplyFrame = false;
+            nextSeq = (seq + 1) & 0x0f;
+            --txQueued;
+
+            reply.insert(reply.end(), f + 1, f + end);
+            done = (f[0] & 0xf0) == MESSAGE_FINISHED_SEQ;
+        }
+    }
+
+    transferNs = simTimeNs() - start;
+    return true;
+}
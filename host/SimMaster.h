@@ -0,0 +1,108 @@
+/*
+    Simulated SPI master of the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SIMMASTER_H_INCLUDED
+#define _SIMMASTER_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+
+/*
+    The master side of the WiFiSpi protocol as the WiFiSpi library runs it on the MCU, written
+    from the protocol description independently of SPICalls.cpp (the frame checks included).
+    The status format is recognized from the status itself, so the master follows the switches
+    of the protocol mode and of the status length. It runs in the master coroutine (SimScheduler.h)
+    and lets the slave run whenever it waits.
+*/
+
+/*
+ * Command message builder: START_CMD, command, number of parameters, parameters, END_CMD
+ */
+class SimMessage {
+public:
+    SimMessage(uint8_t cmd, uint8_t numParams);
+
+    SimMessage &param(const void *value, uint8_t len);
+    SimMessage &paramU8(uint8_t value);
+    SimMessage &paramU16(uint16_t value);
+    SimMessage &paramU32(uint32_t value);
+    SimMessage &paramString(const char *value);
+    SimMessage &paramData(const uint8_t *payload, uint16_t len);  // 16 bit length and the payload
+
+    const std::vector<uint8_t> &bytes();
+
+private:
+    std::vector<uint8_t> msg;
+    bool ended;
+};
+
+/*
+ * Decoded reply: START_CMD, command | REPLY_FLAG, parameters, END_CMD
+ */
+struct SimReply {
+    uint8_t cmd;
+    std::vector<std::vector<uint8_t> > params;
+
+    // Decodes the reply, the parameter of a command in data16 has a 16 bit length
+    bool decode(const std::vector<uint8_t> &msg, bool data16);
+
+    uint8_t u8(uint8_t i) const;
+    uint16_t u16(uint8_t i) const;
+    uint32_t u32(uint8_t i) const;
+};
+
+struct SimMasterStatistics {
+    uint32_t commands;
+    uint32_t framesWritten;
+    uint32_t framesRead;
+    uint32_t framesRewritten;   // written again after a NAK
+    uint32_t resendRequests;    // SPISLAVE_REQ_RESEND written
+    uint32_t repeatedFrames;    // read with a repeated sequence number
+    uint32_t badStatus;         // status not matching any format
+    uint32_t timeouts;
+};
+
+class SimMaster {
+public:
+    SimMaster();
+
+    // Sends the message and receives the reply, returns false on a timeout or a malformed reply
+    bool transfer(SimMessage &msg, SimReply &reply, uint32_t timeoutMs = 2000);
+    bool transfer(const std::vector<uint8_t> &msg, std::vector<uint8_t> &reply, uint32_t timeoutMs);
+
+    // Frame check used by the master, switched after the SET_FRAME_CHECK_CMD message is written
+    void setFrameCheck(uint8_t mode) { frameCheck = mode; }
+
+    // Time of the last transfer from the first frame written to the last frame read [ns]
+    uint64_t lastTransferNs() const { return transferNs; }
+
+    SimMasterStatistics stats;
+
+private:
+    uint8_t frameCheck;
+    uint8_t nextSeq;  // expected sequence number of the next reply frame (PROTOCOL_MODE_CREDIT)
+    uint64_t transferNs;
+
+    uint8_t checkPos() const;
+    void putCheck(uint8_t *frame) const;
+    bool checkOk(const uint8_t *frame) const;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+    Simulated network peers of the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SIMNETWORK_H_INCLUDED
+#define _SIMNETWORK_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+    Every TCP connection goes to a peer sending an endless stream and consuming everything
+    it gets, both streams carry simPattern(offset). The peer acknowledges at once, so the
+    free window is always tcpWindow bytes.
+
+    Every UDP socket receives an endless sequence of datagrams of udpPacketSize bytes,
+    the n-th datagram (counted per socket from 0) comes from simUdpRemoteIP(n):simUdpRemotePort(n)
+    and carries simPattern(n + i). The sent datagrams must carry simPattern(i).
+*/
+
+struct SimNetConfig {
+    uint16_t tcpWindow;      // free space of the transmit window
+    uint16_t tcpRxChunk;     // bytes available for reading at a time
+    uint16_t udpPacketSize;  // size of the received datagrams
+};
+
+struct SimNetStatistics {
+    uint64_t tcpTxBytes;     // bytes received by the TCP peers
+    uint64_t tcpRxBytes;     // bytes sent by the TCP peers
+    uint32_t udpTxPackets;   // datagrams sent by the slave
+    uint64_t udpTxBytes;
+    uint32_t udpRxPackets;   // datagrams received by the slave
+    uint32_t dataErrors;     // sent data not matching the pattern
+};
+
+extern SimNetConfig simNetConfig;
+extern SimNetStatistics simNetStats;
+
+inline uint8_t simPattern(uint32_t offset) {
+    return static_cast<uint8_t>(offset * 13 + (offset >> 8) + 7);
+}
+
+inline uint32_t simUdpRemoteIP(uint32_t n) {
+    return 0x0001a8c0 + ((10 + n % 16) << 24);  // 192.168.1.10 - 192.168.1.25
+}
+
+inline uint16_t simUdpRemotePort(uint32_t n) {
+    return 5000 + n % 1000;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    Virtual clock and scheduler of the host simulation
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SimScheduler.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+double simCpuScale = 30.0;
+
+static const size_t MASTER_STACK_SIZE = 256 * 1024;
+
+static ucontext_t slaveContext;
+static ucontext_t masterContext;
+static void (*masterFunction)() = nullptr;
+static bool masterRunning = false;
+static bool inSlave = true;
+
+static uint64_t timeNs = 0;
+static std::chrono::steady_clock::time_point sliceStart = std::chrono::steady_clock::now();
+
+/*
+ * Adds the CPU time the slave spent since the last call to the virtual clock
+ */
+static void accountSlave() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (inSlave)
+        timeNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sliceStart).count() * simCpuScale);
+    sliceStart = now;
+}
+
+/*
+ * Entry point of the coroutine, on return the slave continues (uc_link)
+ */
+static void masterEntry() {
+    masterFunction();
+    masterRunning = false;
+    inSlave = true;
+    sliceStart = std::chrono::steady_clock::now();
+}
+
+/*
+ *
+ */
+void simStartMaster(void (*master)()) {
+    static char *stack = nullptr;
+
+    if (stack == nullptr)
+        stack = static_cast<char *>(malloc(MASTER_STACK_SIZE));
+
+    getcontext(&masterContext);
+    masterContext.uc_stack.ss_sp = stack;
+    masterContext.uc_stack.ss_size = MASTER_STACK_SIZE;
+    masterContext.uc_link = &slaveContext;
+    makecontext(&masterContext, masterEntry, 0);
+
+    masterFunction = master;
+    masterRunning = true;
+}
+
+/*
+ *
+ */
+bool simMasterRunning() {
+    return masterRunning;
+}
+
+/*
+ *
+ */
+void simRunMaster() {
+    accountSlave();
+
+    if (!masterRunning || !inSlave)
+        return;
+
+    inSlave = false;
+    if (swapcontext(&slaveContext, &masterContext) != 0) {
+        perror("swapcontext");
+        exit(2);
+    }
+    inSlave = true;
+    sliceStart = std::chrono::steady_clock::now();
+}
+
+/*
+ *
+ */
+void simRunSlave() {
+    if (inSlave)
+        return;
+
+    if (swapcontext(&masterContext, &slaveContext) != 0) {
+        perror("swapcontext");
+        exit(2);
+    }
+}
+
+/*
+ *
+ */
+uint64_t simTimeNs() {
+    accountSlave();
+    return timeNs;
+}
+
+/*
+ *
+ */
+void simAdvance(uint64_t ns) {
+    accountSlave();
+    timeNs += ns;
+}
@@ -0,0 +1,59 @@
+/*
+    Virtual clock and scheduler of the host simulation
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SIMSCHEDULER_H_INCLUDED
+#define _SIMSCHEDULER_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+    The sketch (the slave) runs on the main stack, the SPI master runs as a coroutine.
+    The slave hands the CPU over in yield(), delay() and between the loop() calls,
+    the master hands it back when it waits for the slave. The SPI callbacks are called
+    from the master, like the interrupts on the ESP8266 they run between two yields
+    of the slave.
+
+    The virtual clock advances by the modeled SPI bus time of every transaction and by
+    the host CPU time the slave spends between the switches, multiplied by simCpuScale
+    (the ESP8266 runs at 80 MHz, a host is roughly 20-50x faster).
+*/
+
+// Starts the master coroutine, it runs first time at the next yield of the slave
+void simStartMaster(void (*master)());
+
+// The master has not returned yet
+bool simMasterRunning();
+
+// Called by the slave, runs the master until it waits for the slave
+void simRunMaster();
+
+// Called by the master, runs the slave until its next yield
+void simRunSlave();
+
+// Virtual time in nanoseconds
+uint64_t simTimeNs();
+
+// Advances the virtual time (the bus transactions)
+void simAdvance(uint64_t ns);
+
+// Multiplier of the slave host CPU time
+extern double simCpuScale;
+
+#endif
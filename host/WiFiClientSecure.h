@@ -0,0 +1,38 @@
+/*
+    WiFiClientSecure stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _HOST_WIFICLIENTSECURE_H_INCLUDED
+#define _HOST_WIFICLIENTSECURE_H_INCLUDED
+
+#include "ESP8266WiFi.h"
+
+/*
+ * The connection is not encrypted, the peer is the same as for WiFiClient
+ */
+class WiFiClientSecure : public WiFiClient {
+public:
+    bool setFingerprint(const uint8_t fingerprint[20]) { memcpy(this->fingerprint, fingerprint, sizeof(this->fingerprint)); return true; }
+    void setInsecure() { memset(fingerprint, 0, sizeof(fingerprint)); }
+
+private:
+    uint8_t fingerprint[20];
+};
+
+#endif
@@ -0,0 +1,60 @@
+/*
+    WiFiUDP stub for the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _HOST_WIFIUDP_H_INCLUDED
+#define _HOST_WIFIUDP_H_INCLUDED
+
+#include "ESP8266WiFi.h"
+
+/*
+ * UDP socket, receives the datagrams described in SimNetwork.h
+ */
+class WiFiUDP {
+public:
+    WiFiUDP();
+
+    uint8_t begin(uint16_t port);
+    uint8_t beginMulticast(IPAddress interfaceAddr, IPAddress multicast, uint16_t port);
+    void stop();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacketMulticast(IPAddress multicastAddress, uint16_t port, IPAddress interfaceAddress, int ttl = 1);
+    size_t write(const uint8_t *buffer, size_t size);
+    int endPacket();
+
+    int parsePacket();
+    int available();
+    int read();
+    int read(uint8_t *buffer, size_t len);
+    int peek();
+
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+private:
+    bool listening;
+    bool sending;
+    uint32_t packets;   // datagrams parsed so far
+    uint16_t rxPos;     // read position in the current datagram, rxLen when none
+    uint16_t rxLen;
+    uint32_t txLen;
+};
+
+#endif
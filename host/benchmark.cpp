@@ -0,0 +1,469 @@
+/*
+    SPI protocol benchmark on the host simulation
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+    Runs the sketch against the simulated master and network and measures the data commands
+    in every protocol configuration: the frames per second and the payload throughput on the bus,
+    and the latency of the commands from the first frame written by the master to the last reply
+    frame read. All the times are virtual (SimScheduler.h), so the numbers of two builds are
+    comparable on any host. The transferred data is verified, the exit code is 1 on any error.
+*/
+
+#include "Arduino.h"
+#include "SimBus.h"
+#include "SimMaster.h"
+#include "SimNetwork.h"
+#include "SimScheduler.h"
+#include "SPICalls.h"
+#include "WiFiSPICmd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+void setup();
+void loop();
+
+// Protocol configuration
+struct tConfig {
+    uint8_t mode;
+    uint8_t check;
+    uint8_t statusLength;
+};
+
+// Latency of one command type in a scenario
+struct tLatency {
+    uint8_t cmd;
+    const char *name;
+    uint32_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+};
+
+// Options
+static std::vector<tConfig> configs;
+static uint16_t payloadSize = 1024;
+static uint32_t commandCount = 200;
+static bool csvOutput = false;
+
+static SimMaster master;
+static uint32_t errors = 0;
+
+static const uint8_t TCP_SOCK = 0;
+static const uint8_t UDP_SOCK = 1;
+
+// Positions in the streams of the peers, restarted with every connection
+static uint32_t tcpTxOffset;
+static uint32_t tcpRxOffset;
+static uint32_t udpPacket;  // datagrams received by the socket since it was opened
+
+/*
+ * Reports a failed check
+ */
+static void fail(const char *what) {
+    if (++errors <= 10)
+        fprintf(stderr, "ERROR: %s\n", what);
+}
+
+/*
+ * Runs a command, adds its latency to lat
+ */
+static bool command(SimMessage &msg, SimReply &reply, tLatency *lat, uint32_t timeoutMs = 2000) {
+    if (!master.transfer(msg, reply, timeoutMs)) {
+        fail("transfer failed");
+        return false;
+    }
+
+    if (lat != nullptr) {
+        lat->count++;
+        lat->totalNs += master.lastTransferNs();
+        if (master.lastTransferNs() > lat->maxNs)
+            lat->maxNs = master.lastTransferNs();
+    }
+    return true;
+}
+
+/*
+ * Sets the protocol configuration, every command works in any previous configuration
+ */
+static void configure(const tConfig &config) {
+    SimReply reply;
+
+    SimMessage length(SET_STATUS_LENGTH_CMD, 1);
+    length.paramU8(config.statusLength);
+    if (!command(length, reply, nullptr) || reply.u8(0) != 1)
+        fail("SET_STATUS_LENGTH_CMD");
+
+    SimMessage check(SET_FRAME_CHECK_CMD, 1);
+    check.paramU8(config.check);
+    if (!command(check, reply, nullptr) || reply.u8(0) != 1)
+        fail("SET_FRAME_CHECK_CMD");
+
+    SimMessage mode(SET_PROTOCOL_MODE_CMD, 1);
+    mode.paramU8(config.mode);
+    if (!command(mode, reply, nullptr) || reply.u8(0) != 1)
+        fail("SET_PROTOCOL_MODE_CMD");
+}
+
+/*
+ * Opens the TCP client and the UDP socket
+ */
+static void openSockets() {
+    SimReply reply;
+
+    tcpTxOffset = 0;
+    tcpRxOffset = 0;
+    udpPacket = 0;
+
+    SimMessage client(START_CLIENT_TCP_CMD, 4);
+    client.paramU32(IPAddress(192, 168, 1, 100)).paramU16(80).paramU8(TCP_SOCK).paramU8(TCP_MODE);
+    if (!command(client, reply, nullptr) || reply.u8(0) != 1)
+        fail("START_CLIENT_TCP_CMD");
+
+    SimMessage server(START_SERVER_TCP_CMD, 3);
+    server.paramU16(5000).paramU8(UDP_SOCK).paramU8(UDP_MODE);
+    if (!command(server, reply, nullptr) || reply.u8(0) != 1)
+        fail("START_SERVER_TCP_CMD (UDP)");
+}
+
+static void closeSockets() {
+    SimReply reply;
+
+    SimMessage client(STOP_CLIENT_TCP_CMD, 1);
+    client.paramU8(TCP_SOCK);
+    command(client, reply, nullptr);
+
+    SimMessage server(STOP_SERVER_TCP_CMD, 1);
+    server.paramU8(UDP_SOCK);
+    command(server, reply, nullptr);
+}
+
+/*
+ * Scenarios, each runs commandCount times
+ */
+static void scenarioStatus(tLatency *lat) {
+    SimReply reply;
+    SimMessage msg(GET_CONN_STATUS_CMD, 0);
+
+    if (command(msg, reply, &lat[0]) && reply.u8(0) != WL_CONNECTED)
+        fail("GET_CONN_STATUS_CMD");
+}
+
+static void scenarioTcpSend(tLatency *lat) {
+    std::vector<uint8_t> data(payloadSize);
+
+    for (uint16_t i = 0;  i < payloadSize;  ++i)
+        data[i] = simPattern(tcpTxOffset + i);
+
+    SimReply reply;
+    SimMessage msg(SEND_DATA_TCP_CMD, 2);
+    msg.paramU8(TCP_SOCK).paramData(data.data(), payloadSize);
+
+    if (command(msg, reply, &lat[0])) {
+        if (reply.u16(0) != payloadSize)
+            fail("SEND_DATA_TCP_CMD: not all data written");
+        tcpTxOffset += reply.u16(0);
+    }
+}
+
+static void scenarioTcpRecv(tLatency *lat) {
+    SimReply reply;
+    SimMessage msg(GET_DATABUF_TCP_CMD, 2);
+    msg.paramU8(TCP_SOCK).paramU16(payloadSize);
+
+    if (command(msg, reply, &lat[0])) {
+        const std::vector<uint8_t> &data = reply.params[0];
+
+        if (data.size() == 0 || data.size() > payloadSize)
+            fail("GET_DATABUF_TCP_CMD: bad length");
+        for (size_t i = 0;  i < data.size();  ++i) {
+            if (data[i] != simPattern(tcpRxOffset + i)) {
+                fail("GET_DATABUF_TCP_CMD: bad data");
+                break;
+            }
+        }
+        tcpRxOffset += data.size();
+    }
+}
+
+static void scenarioUdpSend(tLatency *lat) {
+    uint16_t size = std::min(payloadSize, static_cast<uint16_t>(UDP_MAX_PACKET_SIZE));
+    std::vector<uint8_t> data(size);
+
+    for (uint16_t i = 0;  i < size;  ++i)
+        data[i] = simPattern(i);
+
+    SimReply reply;
+
+    SimMessage begin(BEGIN_UDP_PACKET_CMD, 3);
+    begin.paramU32(IPAddress(192, 168, 1, 100)).paramU16(6000).paramU8(UDP_SOCK);
+    if (command(begin, reply, &lat[0]) && reply.u8(0) != 1)
+        fail("BEGIN_UDP_PACKET_CMD");
+
+    SimMessage insert(INSERT_DATABUF_CMD, 2);
+    insert.paramU8(UDP_SOCK).paramData(data.data(), size);
+    if (command(insert, reply, &lat[1]) && reply.u16(0) != size)
+        fail("INSERT_DATABUF_CMD: not all data inserted");
+
+    SimMessage send(SEND_DATA_UDP_CMD, 1);
+    send.paramU8(UDP_SOCK);
+    if (command(send, reply, &lat[2]) && reply.u8(0) != 1)
+        fail("SEND_DATA_UDP_CMD");
+}
+
+/*
+    The order of an echo server: parse the packet, read it, get the sender for the answer
+ */
+static void scenarioUdpRecv(tLatency *lat) {
+    uint16_t size = simNetConfig.udpPacketSize;
+
+    SimReply reply;
+
+    SimMessage parse(UDP_PARSE_PACKET_CMD, 1);
+    parse.paramU8(UDP_SOCK);
+    if (!command(parse, reply, &lat[0]))
+        return;
+    if (reply.u16(0) != size)
+        fail("UDP_PARSE_PACKET_CMD: bad size");
+
+    SimMessage read(GET_DATABUF_TCP_CMD, 2);
+    read.paramU8(UDP_SOCK).paramU16(size);
+    if (command(read, reply, &lat[1])) {
+        const std::vector<uint8_t> &data = reply.params[0];
+
+        if (data.size() != size)
+            fail("GET_DATABUF_TCP_CMD (UDP): bad length");
+        for (size_t i = 0;  i < data.size();  ++i) {
+            if (data[i] != simPattern(udpPacket + i)) {
+                fail("GET_DATABUF_TCP_CMD (UDP): bad data");
+                break;
+            }
+        }
+    }
+
+    SimMessage remote(GET_REMOTE_DATA_CMD, 1);
+    remote.paramU8(UDP_SOCK);
+    if (command(remote, reply, &lat[2]) && (reply.u32(0) != simUdpRemoteIP(udpPacket) || reply.u16(1) != simUdpRemotePort(udpPacket)))
+        fail("GET_REMOTE_DATA_CMD: wrong sender");
+
+    ++udpPacket;
+}
+
+struct tScenario {
+    const char *name;
+    void (*run)(tLatency *lat);
+    uint32_t payload;  // payload bytes of one run
+    tLatency lat[3];
+};
+
+static const char *configName(const tConfig &config) {
+    static char name[40];
+
+    snprintf(name, sizeof(name), "%s, %s, %u byte status", config.mode == PROTOCOL_MODE_CREDIT ? "credit" : "confirm",
+        config.check == FRAME_CHECK_CRC16 ? "crc16" : "crc8", config.statusLength);
+    return name;
+}
+
+/*
+ * Runs all the scenarios in the configuration and prints the results
+ */
+static void runConfig(const tConfig &config) {
+    uint16_t udpSize = std::min(payloadSize, static_cast<uint16_t>(UDP_MAX_PACKET_SIZE));
+
+    tScenario scenarios[] = {
+        { "status", scenarioStatus, 0, { { GET_CONN_STATUS_CMD, "GET_CONN_STATUS", 0, 0, 0 } } },
+        { "tcp-send", scenarioTcpSend, payloadSize, { { SEND_DATA_TCP_CMD, "SEND_DATA_TCP", 0, 0, 0 } } },
+        { "tcp-recv", scenarioTcpRecv, payloadSize, { { GET_DATABUF_TCP_CMD, "GET_DATABUF_TCP", 0, 0, 0 } } },
+        { "udp-send", scenarioUdpSend, udpSize, { { BEGIN_UDP_PACKET_CMD, "BEGIN_UDP_PACKET", 0, 0, 0 },
+                                                  { INSERT_DATABUF_CMD, "INSERT_DATABUF", 0, 0, 0 },
+                                                  { SEND_DATA_UDP_CMD, "SEND_DATA_UDP", 0, 0, 0 } } },
+        { "udp-recv", scenarioUdpRecv, udpSize, { { UDP_PARSE_PACKET_CMD, "UDP_PARSE_PACKET", 0, 0, 0 },
+                                                  { GET_DATABUF_TCP_CMD, "GET_DATABUF_TCP", 0, 0, 0 },
+                                                  { GET_REMOTE_DATA_CMD, "GET_REMOTE_DATA", 0, 0, 0 } } },
+    };
+
+    simNetConfig.udpPacketSize = udpSize;
+
+    configure(config);
+    openSockets();
+
+    if (!csvOutput) {
+        printf("\n== %s ==\n", configName(config));
+        printf("%-10s %9s %11s %12s %14s\n", "scenario", "commands", "time [ms]", "frames/s", "payload [kB/s]");
+    }
+
+    for (tScenario &sc : scenarios) {
+        SimBusStatistics bus = simBusStats;
+        uint64_t start = simTimeNs();
+
+        for (uint32_t i = 0;  i < commandCount;  ++i)
+            sc.run(sc.lat);
+
+        double seconds = (simTimeNs() - start) / 1e9;
+        uint32_t frames = (simBusStats.dataWrites - bus.dataWrites) + (simBusStats.dataReads - bus.dataReads);
+        double framesPerSec = frames / seconds;
+        double kBPerSec = sc.payload * static_cast<double>(commandCount) / seconds / 1000;
+
+        if (!csvOutput)
+            printf("%-10s %9u %11.1f %12.0f %14.1f\n", sc.name, commandCount, seconds * 1000, framesPerSec, kBPerSec);
+
+        for (tLatency &lat : sc.lat) {
+            if (lat.count == 0)
+                continue;
+
+            double avgUs = lat.totalNs / 1e3 / lat.count;
+            double maxUs = lat.maxNs / 1e3;
+
+            if (csvOutput)
+                printf("%s,%s,%s,%u,%.1f,%.1f,%.0f,%.1f\n", configName(config), sc.name, lat.name, lat.count,
+                    avgUs, maxUs, framesPerSec, kBPerSec);
+            else
+                printf("    %-18s latency avg %8.1f us, max %8.1f us\n", lat.name, avgUs, maxUs);
+        }
+    }
+
+    closeSockets();
+}
+
+/*
+ * The master coroutine
+ */
+static void masterMain() {
+    if (csvOutput)
+        printf("config,scenario,command,count,avg_us,max_us,frames_per_s,payload_kB_per_s\n");
+
+    for (const tConfig &config : configs)
+        runConfig(config);
+
+    errors += simNetStats.dataErrors;
+
+    if (!csvOutput) {
+        const SimMasterStatistics &st = master.stats;
+        printf("\nbus: %u status reads, %u status writes, %u frames written, %u frames read, %u corrupted\n",
+            simBusStats.statusReads, simBusStats.statusWrites, simBusStats.dataWrites, simBusStats.dataReads,
+            simBusStats.corrupted);
+        printf("master: %u commands, %u frames rewritten, %u resend requests, %u repeated frames, %u bad status, %u timeouts\n",
+            st.commands, st.framesRewritten, st.resendRequests, st.repeatedFrames, st.badStatus, st.timeouts);
+        printf("network: %u data errors\n", simNetStats.dataErrors);
+        printf("%s\n", errors == 0 ? "OK" : "FAILED");
+    }
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+        "  --mode confirm|credit   protocol mode (default: a set of configurations)\n"
+        "  --check crc8|crc16      frame check\n"
+        "  --status 2|4            status length\n"
+        "  --size N                payload bytes per command (default 1024)\n"
+        "  --count N               commands per scenario (default 200)\n"
+        "  --clock HZ              SPI clock (default 4000000)\n"
+        "  --gap NS                time between two transactions (default 5000)\n"
+        "  --cpu-scale X           ESP8266 time per host CPU time (default 30)\n"
+        "  --corrupt N             flip a bit in one in N frames at random (default 0 = never)\n"
+        "  --serial                print the Serial output of the sketch to stderr\n"
+        "  --csv                   print the results as CSV\n", prog);
+}
+
+int main(int argc, char **argv) {
+    tConfig config = { PROTOCOL_MODE_CONFIRM, FRAME_CHECK_CRC8, 2 };
+    bool single = false;
+
+    for (int i = 1;  i < argc;  ++i) {
+        std::string opt = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : "";
+
+        if (opt == "--mode") {
+            config.mode = strcmp(value, "credit") == 0 ? PROTOCOL_MODE_CREDIT : PROTOCOL_MODE_CONFIRM;
+            single = true;
+            ++i;
+        }
+        else if (opt == "--check") {
+            config.check = strcmp(value, "crc16") == 0 ? FRAME_CHECK_CRC16 : FRAME_CHECK_CRC8;
+            single = true;
+            ++i;
+        }
+        else if (opt == "--status") {
+            config.statusLength = atoi(value) == 4 ? 4 : 2;
+            single = true;
+            ++i;
+        }
+        else if (opt == "--size") {
+            payloadSize = atoi(value);
+            ++i;
+        }
+        else if (opt == "--count") {
+            commandCount = atoi(value);
+            ++i;
+        }
+        else if (opt == "--clock") {
+            simBusConfig.clockHz = atoi(value);
+            ++i;
+        }
+        else if (opt == "--gap") {
+            simBusConfig.gapNs = atoi(value);
+            ++i;
+        }
+        else if (opt == "--cpu-scale") {
+            simCpuScale = atof(value);
+            ++i;
+        }
+        else if (opt == "--corrupt") {
+            simBusConfig.corruptEvery = atoi(value);
+            ++i;
+        }
+        else if (opt == "--serial")
+            simSerialOutput = true;
+        else if (opt == "--csv")
+            csvOutput = true;
+        else {
+            usage(argv[0]);
+            return opt == "--help" ? 0 : 2;
+        }
+    }
+
+    if (payloadSize == 0 || simBusConfig.clockHz == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (single)
+        configs.push_back(config);
+    else {
+        configs.push_back({ PROTOCOL_MODE_CONFIRM, FRAME_CHECK_CRC8, 2 });
+        configs.push_back({ PROTOCOL_MODE_CREDIT, FRAME_CHECK_CRC8, 2 });
+        configs.push_back({ PROTOCOL_MODE_CREDIT, FRAME_CHECK_CRC8, 4 });
+        configs.push_back({ PROTOCOL_MODE_CREDIT, FRAME_CHECK_CRC16, 4 });
+    }
+
+    if (!csvOutput)
+        printf("SPI %.1f MHz, %u ns between transactions, CPU scale %.0f, %u bytes payload, %u commands per scenario\n",
+            simBusConfig.clockHz / 1e6, simBusConfig.gapNs, simCpuScale, payloadSize, commandCount);
+
+    simStartMaster(masterMain);
+
+    setup();
+    while (simMasterRunning()) {
+        loop();
+        simRunMaster();
+    }
+
+    return errors == 0 ? 0 : 1;
+}
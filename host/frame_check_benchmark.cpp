@@ -0,0 +1,158 @@
+/*
+    Microbenchmark of the frame checks on the host
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+    Compares the frame checks of SPIFrameCheck.cpp with the crc8 of version 0.3.0 (two nibble tables
+    in PROGMEM) on the receive path (check of a whole frame) and on the transmit path (the crc of
+    a reply frame, accumulated while the frame is written or computed at once in flush).
+    The times are measured on the host CPU, only the ratios between the variants carry over
+    to the ESP8266. All the variants are verified to give the same crc8.
+*/
+
+#include "Arduino.h"
+#include "SPICalls.h"
+#include "SPIFrameCheck.h"
+
+#include <chrono>
+#include <stdio.h>
+
+// crc8 of version 0.3.0, the reference
+static uint8_t crc8(uint8_t *buffer, uint8_t bufLen) {
+    static const uint8_t PROGMEM tableLow[] = { 0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D };
+    static const uint8_t PROGMEM tableHigh[] = { 0x00, 0x70, 0xE0, 0x90, 0xC7, 0xB7, 0x27, 0x57, 0x89, 0xF9, 0x69, 0x19, 0x4E, 0x3E, 0xAE, 0xDE };
+
+    uint8_t crcValue = 0;
+
+    for (int i = 0; i < bufLen; ++i) {
+        crcValue ^= buffer[i];
+        crcValue = pgm_read_byte(tableLow + (crcValue & 0x0f)) ^ pgm_read_byte(tableHigh + ((crcValue >> 4) & 0x0f));
+    }
+
+    return crcValue;
+}
+
+static const int FRAMES = 64;
+static const uint32_t ROUNDS = 40000;  // ROUNDS * FRAMES frames per variant
+
+static uint8_t frames[FRAMES][32];
+static volatile uint32_t sink;
+
+/*
+ * Random frames with a valid check in the current mode
+ */
+static void makeFrames() {
+    uint32_t seed = 12345;
+
+    for (int f = 0;  f < FRAMES;  ++f) {
+        for (int i = 0;  i < 32;  ++i) {
+            seed = seed * 1103515245 + 12345;
+            frames[f][i] = seed >> 16;
+        }
+        frames[f][0] = MESSAGE_CONTINUES_SEQ | (f & 0x0f);
+        frameCrcPut(frames[f], frameCrcUpdate(0, frames[f] + 1, frameCheckPos - 1));
+    }
+}
+
+/*
+ * Runs the variant over all the frames ROUNDS times, returns ns per frame
+ */
+template <typename F> static double measure(F variant) {
+    uint32_t acc = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (uint32_t r = 0;  r < ROUNDS;  ++r)
+        for (int f = 0;  f < FRAMES;  ++f)
+            acc += variant(frames[f]);
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    sink = acc;
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / (static_cast<double>(ROUNDS) * FRAMES);
+}
+
+static void report(const char *name, double ns, double reference) {
+    printf("  %-44s %7.1f ns/frame  %5.2fx\n", name, ns, reference / ns);
+}
+
+int main() {
+    uint32_t errors = 0;
+
+    // Receive path: check of a whole frame
+    setFrameCheckMode(FRAME_CHECK_CRC8);
+    makeFrames();
+
+    for (int f = 0;  f < FRAMES;  ++f) {
+        if (crc8(frames[f], 31) != frames[f][31] || !frameCrcOk(frames[f]))
+            ++errors;
+    }
+
+    printf("receive (check of a frame)\n");
+    double reference = measure([](uint8_t *frame) { return crc8(frame, 31) == frame[31]; });
+    report("crc8 nibble tables in PROGMEM (0.3.0)", reference, reference);
+    report("crc8 256 entry table (frameCrcOk)", measure([](uint8_t *frame) { return frameCrcOk(frame); }), reference);
+
+    setFrameCheckMode(FRAME_CHECK_CRC16);
+    makeFrames();
+    report("crc16 256 entry table (frameCrcOk)", measure([](uint8_t *frame) { return frameCrcOk(frame); }), reference);
+
+    // Transmit path: the reply header (3 bytes) and the data written in segments, then the indicator
+    printf("transmit (crc of a reply frame)\n");
+    setFrameCheckMode(FRAME_CHECK_CRC8);
+    makeFrames();
+
+    reference = measure([](uint8_t *frame) {
+        frame[31] = crc8(frame, 31);
+        return frame[31];
+    });
+    report("crc8 nibble tables in flush (0.3.0)", reference, reference);
+
+    auto accumulated = [](uint8_t *frame) {
+        uint8_t end = frameCheckPos;
+        uint16_t crc = frameCrcUpdate(0, frame + 1, 3);
+        crc = frameCrcUpdate(crc, frame + 4, 8);
+        crc = frameCrcUpdate(crc, frame + 12, end - 12);
+        frameCrcPut(frame, crc);
+        return frame[31];
+    };
+
+    for (int f = 0;  f < FRAMES;  ++f) {
+        uint8_t expected = crc8(frames[f], 31);
+        if (accumulated(frames[f]) != expected)
+            ++errors;
+    }
+
+    report("crc8 accumulated while written + indicator", measure(accumulated), reference);
+    report("crc8 256 entry table in flush", measure([](uint8_t *frame) {
+        frameCrcPut(frame, frameCrcUpdate(0, frame + 1, 30));
+        return frame[31];
+    }), reference);
+
+    setFrameCheckMode(FRAME_CHECK_CRC16);
+    makeFrames();
+    report("crc16 accumulated while written + indicator", measure(accumulated), reference);
+
+    for (int f = 0;  f < FRAMES;  ++f) {
+        if (!frameCrcOk(frames[f]))
+            ++errors;
+    }
+
+    printf("%s\n", errors == 0 ? "OK" : "FAILED: the variants differ");
+    return errors == 0 ? 0 : 1;
+}
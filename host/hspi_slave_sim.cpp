@@ -0,0 +1,166 @@
+/*
+    Simulated HSPI slave, replaces hspi_slave.c in the host build
+
+  Copyright (c) 2026 WiFiSpiESP contributors. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+
+extern "C" {
+    #include "hspi_slave.h"
+}
+
+#include "SimBus.h"
+#include "SimScheduler.h"
+
+SimBusConfig simBusConfig = { 4000000, 5000, 0 };
+SimBusStatistics simBusStats;
+
+/*
+    The registers shared by the master and the slave: SPI1WS is the status register,
+    SPI1W0-7 hold the frame written by the master, SPI1W8-15 the frame for the master.
+    The status is overwritten by the master as on the hardware.
+*/
+static uint32_t statusRegister = 0;
+static uint8_t statusLength = 4;
+static uint8_t receiveRegister[32];
+static uint8_t dataRegister[32];
+static uint32_t corruptRandom = 2463534242u;  // xorshift32 state, fixed seed so the runs repeat
+
+static void *callbackArg = nullptr;
+static void (*dataReceived)(void *, uint8_t *, uint8_t) = nullptr;
+static void (*dataSent)(void *) = nullptr;
+static void (*statusReceived)(void *, uint16_t) = nullptr;
+static void (*statusSent)(void *) = nullptr;
+
+/*
+ * Bus time of a transaction with the command byte and len bytes of data
+ */
+static void busTransaction(uint8_t len) {
+    simAdvance(simBusConfig.gapNs + (1 + len) * 8 * 1000000000ull / simBusConfig.clockHz);
+}
+
+/*
+ * Flips a bit of one in corruptEvery frames at random. Not every n-th frame: the master resending
+ * a group of n frames would hit the same frame again and again.
+ */
+static void corruptFrame(uint8_t *frame) {
+    if (simBusConfig.corruptEvery == 0)
+        return;
+
+    corruptRandom ^= corruptRandom << 13;
+    corruptRandom ^= corruptRandom >> 17;
+    corruptRandom ^= corruptRandom << 5;
+    if (corruptRandom % simBusConfig.corruptEvery != 0)
+        return;
+
+    frame[(corruptRandom >> 8) % 32] ^= 0x10;
+    ++simBusStats.corrupted;
+}
+
+/*
+ * Slave side (hspi_slave.h)
+ */
+void hspi_slave_begin(uint8_t status_len, void *arg) {
+    callbackArg = arg;
+    hspi_slave_setStatusLength(status_len);
+}
+
+void hspi_slave_setStatusLength(uint8_t status_len) {
+    if (status_len >= 1 && status_len <= 4)
+        statusLength = status_len;
+}
+
+void hspi_slave_setStatus(uint32_t status) {
+    statusRegister = status;
+}
+
+uint32_t hspi_slave_getStatus() {
+    return statusRegister;
+}
+
+void hspi_slave_setData(uint8_t *data, uint8_t len) {
+    if (len > 32)
+        len = 32;
+    memcpy(dataRegister, data, len);
+    memset(dataRegister + len, 0, 32 - len);
+}
+
+void hspi_slave_onData(void (*rxd_cb)(void *, uint8_t *, uint8_t)) {
+    dataReceived = rxd_cb;
+}
+
+void hspi_slave_onDataSent(void (*txd_cb)(void *)) {
+    dataSent = txd_cb;
+}
+
+void hspi_slave_onStatus(void (*rxs_cb)(void *, uint16_t)) {
+    statusReceived = rxs_cb;
+}
+
+void hspi_slave_onStatusSent(void (*txs_cb)(void *)) {
+    statusSent = txs_cb;
+}
+
+/*
+ * Master side (SimBus.h)
+ */
+uint32_t simBusReadStatus() {
+    busTransaction(statusLength);
+    ++simBusStats.statusReads;
+
+    uint32_t status = statusRegister;
+    if (statusLength < 4)
+        status &= (1ul << (8 * statusLength)) - 1;
+
+    if (statusSent != nullptr)
+        statusSent(callbackArg);
+    return status;
+}
+
+void simBusWriteStatus(uint32_t status) {
+    busTransaction(statusLength);
+    ++simBusStats.statusWrites;
+
+    statusRegister = status;
+    if (statusReceived != nullptr)
+        statusReceived(callbackArg, status & 0xffff);
+}
+
+void simBusWriteData(const uint8_t *frame) {
+    busTransaction(33);  // address byte and 32 bytes of data
+    ++simBusStats.dataWrites;
+
+    memcpy(receiveRegister, frame, sizeof(receiveRegister));
+    corruptFrame(receiveRegister);
+    if (dataReceived != nullptr)
+        dataReceived(callbackArg, receiveRegister, sizeof(receiveRegister));
+}
+
+void simBusReadData(uint8_t *frame) {
+    busTransaction(33);
+    ++simBusStats.dataReads;
+
+    memcpy(frame, dataRegister, sizeof(dataRegister));
+    corruptFrame(frame);
+    if (dataSent != nullptr)
+        dataSent(callbackArg);
+}
+
+uint8_t simBusStatusLength() {
+    return statusLength;
+}
@@ -0,0 +1,5 @@
+/*
+    The sketch compiled as an ordinary translation unit of the host build
+*/
+
+#include "WiFiSPIESP.ino"